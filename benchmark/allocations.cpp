@@ -0,0 +1,187 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Counts heap allocations per message in a warmed up client/server exchange and fails when a stage
+// allocates more than its budget. Client and server run on separate io_contexts so that each
+// asynchronous stage can be driven, and accounted, on its own.
+
+#include <tiny_ipc/client.hpp>
+#include <tiny_ipc/server_session.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/connect_pair.hpp>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace
+{
+std::atomic<std::size_t> allocations{0};
+}
+
+extern "C"
+{
+void* __libc_malloc(std::size_t);
+void* __libc_calloc(std::size_t, std::size_t);
+void* __libc_realloc(void*, std::size_t);
+void* __libc_memalign(std::size_t, std::size_t);
+
+void* malloc(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+void* calloc(std::size_t count, std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+void* realloc(void* ptr, std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+void* aligned_alloc(std::size_t alignment, std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+}
+
+void* operator new(std::size_t size)
+{
+    if (void* ret = std::malloc(size ? size : 1)) return ret;
+    throw std::bad_alloc{};
+}
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept { return std::malloc(size ? size : 1); }
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept { return std::malloc(size ? size : 1); }
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void* ret = aligned_alloc(static_cast<std::size_t>(alignment), size ? size : 1)) return ret;
+    throw std::bad_alloc{};
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) { return ::operator new(size, alignment); }
+void  operator delete(void* ptr) noexcept { std::free(ptr); }
+void  operator delete[](void* ptr) noexcept { std::free(ptr); }
+void  operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void  operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void  operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void  operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void  operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void  operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+namespace ti = tiny_ipc;
+using namespace ti::literals;
+
+namespace
+{
+constexpr auto alloc_proto = ti::protocol(  //
+    ti::interface("alloc"_i, "1.0"_v,       //
+                  ti::method<int(int)>("increment"_m),
+                  ti::signal<void(int)>("counted"_s)));
+using alloc_protocol = std::remove_const_t<decltype(alloc_proto)>;
+
+constexpr std::size_t warm_up    = 1000;
+constexpr std::size_t iterations = 10000;
+
+// Allocations per message that each stage may perform. The goal is zero everywhere, lower a budget
+// whenever a path stops allocating so that it cannot silently regress.
+struct stage
+{
+    char const* name;
+    double      budget;
+    std::size_t allocations{0};
+    std::size_t messages{0};
+};
+
+enum stage_id
+{
+    call,
+    server_dispatch,
+    client_reply,
+    signal_send,
+    signal_dispatch,
+    signal_template_send,
+    client_signal,
+    stage_count
+};
+
+stage stages[stage_count] = {
+    {"execute_method", 3},                    // packet buffers and iovecs
+    {"async_dispatch_messages (server)", 3},  // packet of the reply
+    {"reply handling (client)", 0},
+    {"send_signal", 3},                       // packet buffers and iovecs
+    {"dispatch_signal", 3},                   // packet buffers and iovecs
+    {"signal_template", 0},
+    {"async_dispatch_messages (client)", 0},
+};
+
+template <typename F>
+void measure(stage_id id, bool count, F&& f)
+{
+    auto const before = allocations.load(std::memory_order_relaxed);
+    f();
+    if (!count) return;
+    stages[id].allocations += allocations.load(std::memory_order_relaxed) - before;
+    ++stages[id].messages;
+}
+}  // namespace
+
+int main()
+{
+    boost::asio::io_context                     client_io, server_io;
+    boost::asio::local::stream_protocol::socket client_socket(client_io), server_socket(server_io);
+    boost::asio::local::connect_pair(client_socket, server_socket);
+
+    auto const iface = ti::interface_id("alloc"_i, "1.0"_v);
+    int        value = 0;
+    int        seen  = 0;
+
+    ti::client         client(client_socket, [](boost::system::error_code, ti::client&) {});
+    ti::server_session session(server_socket, [](boost::system::error_code, ti::server_session&) {});
+    ti::async_dispatch_messages<alloc_protocol>(session, ti::methods_of("alloc"_i, "1.0"_v, "increment"_m = [](int v) { return v + 1; }));
+    ti::async_dispatch_messages<alloc_protocol>(client, ti::signals_of("alloc"_i, "1.0"_v, "counted"_s = [&seen](int v) { seen = v; }));
+    auto counted_signal = ti::make_signal_template<alloc_protocol>(iface, "counted"_s, 0);
+
+    for (std::size_t i = 0; i != warm_up + iterations; ++i)
+    {
+        bool const counted = i >= warm_up;
+        measure(call, counted, [&] { ti::execute_method<alloc_protocol>(iface, "increment"_m, client, [&value](int v) { value = v; }, value); });
+        measure(server_dispatch, counted, [&] { server_io.run_one(); });
+        measure(client_reply, counted, [&] { client_io.run_one(); });
+
+        measure(signal_send, counted, [&] { ti::send_signal<alloc_protocol>(iface, "counted"_s, session, value); });
+        measure(client_signal, counted, [&] { client_io.run_one(); });
+
+        measure(signal_dispatch, counted, [&] { ti::dispatch_signal<alloc_protocol>(iface, "counted"_s, value)(session); });
+        measure(client_signal, counted, [&] { client_io.run_one(); });
+
+        measure(signal_template_send, counted,
+                [&]
+                {
+                    counted_signal.set<0>(value);
+                    counted_signal(session);
+                });
+        measure(client_signal, counted, [&] { client_io.run_one(); });
+    }
+
+    if (value != static_cast<int>(warm_up + iterations) || seen != value)
+    {
+        std::printf("exchange broken: %d replies, last signal %d\n", value, seen);
+        return EXIT_FAILURE;
+    }
+
+    bool over_budget = false;
+    std::printf("%-36s %12s %8s\n", "stage", "allocs/msg", "budget");
+    for (auto const& s : stages)
+    {
+        auto const per_message = static_cast<double>(s.allocations) / s.messages;
+        bool const exceeded    = per_message > s.budget;
+        over_budget |= exceeded;
+        std::printf("%-36s %12.2f %8.2f%s\n", s.name, per_message, s.budget, exceeded ? "  <- over budget" : "");
+    }
+    return over_budget ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures the codecs of encode.hpp and decode.hpp in isolation: messages are encoded into packets and
+// decoded from a message_parser over a flat buffer, no socket is involved.
+
+#include <tiny_ipc/proto_def.hpp>
+#include <tiny_ipc/detail/protocol.hpp>
+#include <tiny_ipc/detail/encode.hpp>
+#include <tiny_ipc/detail/decode.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+
+namespace ti = tiny_ipc;
+using namespace ti::literals;
+
+namespace
+{
+struct point
+{
+    float x;
+    float y;
+    float z;
+};
+
+struct record
+{
+    uint32_t           id;
+    std::string        name;
+    std::vector<point> samples;
+    uint64_t           timestamp;
+};
+
+constexpr auto bench_proto = ti::protocol(  //
+    ti::interface("bench"_i, "1.0"_v,       //
+                  ti::method<int(int, int)>("add"_m),
+                  ti::method<bool(std::string, std::vector<int>)>("store"_m),
+                  ti::method<void(ti::fd, std::string, uint64_t)>("attach"_m),
+                  ti::signal<void(record)>("recorded"_s)));
+using bench_protocol = std::remove_const_t<decltype(bench_proto)>;
+using bench_iface    = ti::get_interface<bench_protocol, decltype(ti::interface_id("bench"_i, "1.0"_v))>;
+template <typename Name>
+using element = ti::detail::get_signature<bench_iface, Name>;
+
+template <typename T>
+inline void do_not_optimize(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+constexpr std::size_t iterations = 200000;
+
+// Runs op until the timings settle and reports the time and payload bytes per invocation, op returns the
+// number of payload bytes it processed.
+template <typename Op>
+void run(char const* name, Op&& op)
+{
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i != iterations / 10; ++i) bytes = op();
+
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i != iterations; ++i) do_not_optimize(op());
+    auto const end = std::chrono::steady_clock::now();
+
+    auto const ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    std::printf("%-40s %10.1f ns/op %8zu bytes/op\n", name, ns, bytes);
+}
+
+ti::packet make_packet() { return ti::packet(ti::msg_header{{1, 1, 0}, 128, 0}); }
+
+std::size_t payload_size(ti::packet const& p) { return p.size() - sizeof(ti::msg_header); }
+
+// Payload and descriptors of an encoded message, laid out like a received message.
+struct received
+{
+    std::vector<char>          payload;
+    msghdr                     hdr{};
+    ti::detail::message_parser parser{&hdr, {}};
+
+    explicit received(ti::packet& p)
+    {
+        p.commit_to_header();
+        for (auto const& buf : p.buffers) payload.insert(payload.end(), buf.begin(), buf.end());
+        payload.erase(payload.begin(), payload.begin() + sizeof(ti::msg_header));
+        for (int file_desc : p.fds) parser.fds.emplace_back(ti::weak_ref{file_desc});
+    }
+
+    // rewinds the parser to the start of the payload
+    ti::detail::message_parser& rewind()
+    {
+        parser.message_payload = std::span<char>(payload.data(), payload.size());
+        parser.consumed_fds    = 0;
+        return parser;
+    }
+};
+
+template <typename T, typename U>
+void bench_encode(char const* name, U const& value)
+{
+    run(name,
+        [&value]()
+        {
+            auto p = make_packet();
+            encode_item(p, ti::type<T>{}, value);
+            return payload_size(p);
+        });
+}
+
+template <typename T, typename As = T, typename U>
+void bench_decode(char const* name, U const& value)
+{
+    auto p = make_packet();
+    encode_item(p, ti::type<T>{}, value);
+    received msg(p);
+    run(name,
+        [&msg]()
+        {
+            auto& parser = msg.rewind();
+            do_not_optimize(decode_item(parser, ti::type<As>{}));
+            return msg.payload.size();
+        });
+}
+
+template <typename Element, typename... Ts>
+void bench_signature(char const* name, Ts const&... params)
+{
+    run(name,
+        [&params...]()
+        {
+            auto p = make_packet();
+            ti::detail::encode<Element>(p, params...);
+            return payload_size(p);
+        });
+}
+
+template <typename Element, typename... Ts>
+void bench_signature_decode(char const* name, Ts const&... params)
+{
+    auto p = make_packet();
+    ti::detail::encode<Element>(p, params...);
+    received msg(p);
+    run(name,
+        [&msg]()
+        {
+            ti::detail::decode<Element>(msg.rewind(), [](auto const&... values) { (do_not_optimize(values), ...); });
+            return msg.payload.size();
+        });
+}
+}  // namespace
+
+int main()
+{
+    std::string const        short_text = "hello";
+    std::string const        long_text(1000, 'x');
+    std::string_view const   text_view  = long_text;
+    std::vector<int> const   numbers(256, 42);
+    std::vector<std::string> words(32, short_text);
+    std::vector<float>       floats(256, 1.5f);
+    std::span<float const>   float_span(floats);
+    std::vector<double>      doubles(4096, 2.5);
+    std::vector<int64_t>     wide_numbers(4096, 42);
+    point const              p{1, 2, 3};
+    record const             r{7, "sensor", std::vector<point>(16, p), 123456789};
+    ti::fd const             null_fd(::dup(STDIN_FILENO));
+
+    std::printf("encode_item\n");
+    bench_encode<int>("int", 42);
+    bench_encode<std::string>("string from std::string (5)", short_text);
+    bench_encode<std::string>("string from std::string (1000)", long_text);
+    bench_encode<std::string>("string from char const* (1000)", long_text.c_str());
+    bench_encode<std::string>("string from string_view (1000)", text_view);
+    bench_encode<std::vector<int>>("vector<int> (256)", numbers);
+    bench_encode<std::vector<std::string>>("vector<string> (32)", words);
+    bench_encode<std::span<float const>>("span<float> (256)", float_span);
+    bench_encode<std::vector<float>>("vector<float> from doubles (4096)", doubles);
+    bench_encode<std::vector<int32_t>>("vector<int32_t> from int64_t (4096)", wide_numbers);
+    bench_encode<ti::fd>("fd", null_fd);
+    bench_encode<point>("trivially serializable struct", p);
+    bench_encode<record>("aggregate with strings and vectors", r);
+
+    std::printf("\ndecode_item\n");
+    bench_decode<int>("int", 42);
+    bench_decode<std::string>("string (1000)", long_text);
+    bench_decode<std::string, std::string_view>("string as string_view (1000)", long_text);
+    bench_decode<std::vector<int>>("vector<int> (256)", numbers);
+    bench_decode<std::vector<std::string>>("vector<string> (32)", words);
+    bench_decode<ti::fd>("fd", null_fd);
+    bench_decode<point>("trivially serializable struct", p);
+    bench_decode<record>("aggregate with strings and vectors", r);
+
+    std::printf("\nsignatures\n");
+    bench_signature<element<decltype("add"_m)>>("encode int(int, int)", 1, 2);
+    bench_signature<element<decltype("store"_m)>>("encode bool(string, vector<int>)", short_text, numbers);
+    bench_signature<element<decltype("attach"_m)>>("encode void(fd, string, uint64_t)", null_fd, short_text, uint64_t{7});
+    bench_signature<element<decltype("recorded"_s)>>("encode void(record)", r);
+    bench_signature_decode<element<decltype("add"_m)>>("decode int(int, int)", 1, 2);
+    bench_signature_decode<element<decltype("store"_m)>>("decode bool(string, vector<int>)", short_text, numbers);
+    bench_signature_decode<element<decltype("attach"_m)>>("decode void(fd, string, uint64_t)", null_fd, short_text, uint64_t{7});
+    bench_signature_decode<element<decltype("recorded"_s)>>("decode void(record)", r);
+}
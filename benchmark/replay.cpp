@@ -0,0 +1,208 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Feeds the frames of a capture file into a server, one connection per captured connection, either as
+// fast as possible or at the recorded pacing. Replies are read and dropped.
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <tiny_ipc/capture.hpp>
+#include <tiny_ipc/detail/handshake.hpp>
+#include <tiny_ipc/detail/protocol.hpp>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace
+{
+int connect_to(char const* path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    int socket_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_fd < 0) return -1;
+    if (::connect(socket_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        ::close(socket_fd);
+        return -1;
+    }
+    return socket_fd;
+}
+
+// reads and drops everything the server sent so far
+void drain(std::map<uint32_t, int> const& connections)
+{
+    char scratch[64 * 1024];
+    char control[1024];
+    for (auto const& [id, socket_fd] : connections)
+    {
+        for (;;)
+        {
+            iovec  vec{scratch, sizeof(scratch)};
+            msghdr hdr{nullptr, 0, &vec, 1, control, sizeof(control), 0};
+            if (::recvmsg(socket_fd, &hdr, MSG_DONTWAIT | MSG_CMSG_CLOEXEC) <= 0) break;
+            for (cmsghdr* control_header = CMSG_FIRSTHDR(&hdr); control_header; control_header = CMSG_NXTHDR(&hdr, control_header))
+            {
+                if (control_header->cmsg_type != SCM_RIGHTS) continue;
+                for (std::size_t i = 0; i != (control_header->cmsg_len - CMSG_LEN(0)) / sizeof(int); ++i)
+                {
+                    int file_desc;
+                    std::memcpy(&file_desc, CMSG_DATA(control_header) + i * sizeof(int), sizeof(int));
+                    ::close(file_desc);
+                }
+            }
+        }
+    }
+}
+
+bool is_hello(std::vector<char> const& frame)
+{
+    tiny_ipc::msg_header header;
+    if (frame.size() < sizeof(header)) return false;
+    std::memcpy(&header, frame.data(), sizeof(header));
+    return header.id.interface == tiny_ipc::detail::control_interface && header.id.id == tiny_ipc::detail::control::hello;
+}
+
+// Sends a captured frame, descriptors are replaced by /dev/null and credentials are those of this process.
+// Captures hold the full msg_header of each frame, once the connection sent its hello the server expects
+// the compact header, so the frame is sent in its escaped form then, which works for any protocol.
+bool send_frame(int socket_fd, tiny_ipc::capture_record const& rec, std::vector<char>& frame, int null_fd, bool compact)
+{
+    std::vector<char> control;
+    if (rec.credentials) control.resize(CMSG_SPACE(sizeof(ucred)));
+    std::size_t const rights_offset = control.size();
+    if (rec.fds) control.resize(control.size() + CMSG_SPACE(rec.fds * sizeof(int)));
+
+    if (rec.credentials)
+    {
+        auto* cred_header       = reinterpret_cast<cmsghdr*>(control.data());
+        cred_header->cmsg_len   = CMSG_LEN(sizeof(ucred));
+        cred_header->cmsg_level = SOL_SOCKET;
+        cred_header->cmsg_type  = SCM_CREDENTIALS;
+        ucred const creds{.pid = getpid(), .uid = geteuid(), .gid = getegid()};
+        std::memcpy(CMSG_DATA(cred_header), &creds, sizeof(creds));
+    }
+    if (rec.fds)
+    {
+        auto* rights_header       = reinterpret_cast<cmsghdr*>(control.data() + rights_offset);
+        rights_header->cmsg_len   = CMSG_LEN(rec.fds * sizeof(int));
+        rights_header->cmsg_level = SOL_SOCKET;
+        rights_header->cmsg_type  = SCM_RIGHTS;
+        for (std::size_t i = 0; i != rec.fds; ++i) std::memcpy(CMSG_DATA(rights_header) + i * sizeof(int), &null_fd, sizeof(int));
+    }
+
+    // the receiver sizes its control buffer by the header
+    uint16_t const control_size = control.size();
+    if (frame.size() >= sizeof(tiny_ipc::msg_header))
+        std::memcpy(frame.data() + offsetof(tiny_ipc::msg_header, control), &control_size, sizeof(control_size));
+    if (compact && frame.size() >= sizeof(tiny_ipc::msg_header)) frame.insert(frame.begin(), tiny_ipc::detail::compact_format::escape);
+
+    iovec  vec{frame.data(), frame.size()};
+    msghdr hdr{nullptr, 0, &vec, 1, control.empty() ? nullptr : control.data(), control.size(), 0};
+    for (std::size_t offset = 0; offset < frame.size();)
+    {
+        auto written = ::sendmsg(socket_fd, &hdr, MSG_NOSIGNAL);
+        if (written <= 0) return false;
+        offset += written;
+        vec                = iovec{frame.data() + offset, frame.size() - offset};
+        hdr.msg_control    = nullptr;
+        hdr.msg_controllen = 0;
+    }
+    return true;
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    bool                        paced     = false;
+    tiny_ipc::capture_direction direction = tiny_ipc::capture_direction::received;
+    std::vector<char const*>    positional;
+    for (int i = 1; i != argc; ++i)
+    {
+        std::string_view arg(argv[i]);
+        if (arg == "--paced")
+            paced = true;
+        else if (arg == "--sent")
+            direction = tiny_ipc::capture_direction::sent;
+        else
+            positional.push_back(argv[i]);
+    }
+    if (positional.size() != 2)
+    {
+        std::printf("Usage: replay [--paced] [--sent] CAPTUREFILE SERVERSOCKET\n"
+                    "  replays the frames a server received, or with --sent the frames a client sent\n");
+        return 1;
+    }
+
+    tiny_ipc::capture_reader reader(positional[0]);
+    if (!reader.is_open())
+    {
+        std::printf("cannot read capture %s\n", positional[0]);
+        return 1;
+    }
+    int const null_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    std::map<uint32_t, int>  connections;
+    std::set<uint32_t>       greeted;  // connections that sent their hello
+    tiny_ipc::capture_record rec;
+    std::vector<char>        frame;
+    std::size_t              frames = 0, bytes = 0;
+    uint64_t                 first_timestamp = 0;
+    auto const               start           = std::chrono::steady_clock::now();
+    while (reader.next(rec, frame))
+    {
+        if (rec.direction != direction) continue;
+        if (frames == 0) first_timestamp = rec.timestamp;
+        if (paced) std::this_thread::sleep_until(start + std::chrono::nanoseconds(rec.timestamp - first_timestamp));
+
+        auto connection = connections.find(rec.connection);
+        if (connection == connections.end())
+        {
+            int socket_fd = connect_to(positional[1]);
+            if (socket_fd < 0)
+            {
+                std::printf("cannot connect to %s\n", positional[1]);
+                return 1;
+            }
+            connection = connections.emplace(rec.connection, socket_fd).first;
+        }
+        bool const hello = is_hello(frame);
+        if (!send_frame(connection->second, rec, frame, null_fd, greeted.contains(rec.connection)))
+        {
+            std::printf("connection %u closed by the server after %zu frames\n", rec.connection, frames);
+            return 1;
+        }
+        if (hello) greeted.insert(rec.connection);
+        ++frames;
+        bytes += frame.size();
+        if (frames % 64 == 0) drain(connections);
+    }
+    auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // give the server a moment to answer the last requests before the connections go away
+    for (int i = 0; i != 10; ++i)
+    {
+        drain(connections);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    for (auto const& [id, socket_fd] : connections) ::close(socket_fd);
+    ::close(null_fd);
+
+    std::printf("%zu frames, %zu bytes on %zu connections in %.3f s: %.0f frames/s, %.1f MiB/s\n", frames, bytes, connections.size(),
+                seconds, frames / seconds, bytes / seconds / (1024 * 1024));
+    return 0;
+}
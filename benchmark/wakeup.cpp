@@ -0,0 +1,192 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares the wake-up latency of epoll::reactor and boost::asio::io_context: a byte sent over a
+// socketpair to a thread that echoes it back, a function posted from another thread and a timer
+// expiry. Each case starts with the event loop asleep in epoll_wait.
+
+#include <tiny_ipc/epoll.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace ti = tiny_ipc;
+
+namespace
+{
+using clock_type = std::chrono::steady_clock;
+
+double ns_since(clock_type::time_point t) { return std::chrono::duration<double, std::nano>(clock_type::now() - t).count(); }
+
+struct asio_backend
+{
+    using context = boost::asio::io_context;
+    using socket  = boost::asio::local::stream_protocol::socket;
+    using timer   = boost::asio::steady_timer;
+
+    static constexpr char const* name      = "asio";
+    static constexpr auto        wait_read = boost::asio::socket_base::wait_read;
+
+    static std::unique_ptr<socket> open(context& ctx, int fd) { return std::make_unique<socket>(ctx, boost::asio::local::stream_protocol(), fd); }
+    template <typename F>
+    static void post(context& ctx, F&& f)
+    {
+        boost::asio::post(ctx, std::forward<F>(f));
+    }
+};
+
+struct epoll_backend
+{
+    using context = ti::epoll::reactor;
+    using socket  = ti::epoll::socket;
+    using timer   = ti::epoll::timer;
+
+    static constexpr char const* name      = "epoll";
+    static constexpr auto        wait_read = ti::epoll::wait_read;
+
+    static std::unique_ptr<socket> open(context& ctx, int fd) { return std::make_unique<socket>(ctx, fd); }
+    template <typename F>
+    static void post(context& ctx, F&& f)
+    {
+        ti::epoll::post(ctx.get_executor(), std::forward<F>(f));
+    }
+};
+
+void report(char const* backend, char const* name, std::vector<double>& samples)
+{
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (auto s : samples) sum += s;
+    std::printf("%-6s %-24s %10.0f ns mean %10.0f ns p50 %10.0f ns p99\n", backend, name, sum / samples.size(), samples[samples.size() / 2],
+                samples[samples.size() * 99 / 100]);
+}
+
+template <typename B>
+std::vector<double> socket_round_trips(std::size_t count)
+{
+    int fds[2];
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+    std::thread echo(
+        [fd = fds[1]]
+        {
+            char c;
+            while (::read(fd, &c, 1) == 1 && ::write(fd, &c, 1) == 1) {}
+        });
+
+    typename B::context    ctx;
+    auto                   sock = B::open(ctx, fds[0]);
+    std::vector<double>    samples;
+    clock_type::time_point sent;
+    samples.reserve(count);
+
+    std::function<void()> ping = [&]
+    {
+        char c = 'p';
+        sent   = clock_type::now();
+        if (::write(sock->native_handle(), &c, 1) != 1) return;
+        sock->async_wait(B::wait_read,
+                         [&](boost::system::error_code ec)
+                         {
+                             char r;
+                             if (ec || ::read(sock->native_handle(), &r, 1) != 1) return;
+                             samples.push_back(ns_since(sent));
+                             if (samples.size() < count) ping();
+                         });
+    };
+    ping();
+    ctx.run();
+
+    sock->close();  // ends the echo thread
+    echo.join();
+    ::close(fds[1]);
+    return samples;
+}
+
+template <typename B>
+std::vector<double> post_latencies(std::size_t count)
+{
+    typename B::context ctx;
+    typename B::timer   keep_running(ctx);
+    keep_running.expires_after(std::chrono::hours(1));
+    keep_running.async_wait([](boost::system::error_code) {});
+
+    std::vector<double>      samples(count);
+    std::atomic<std::size_t> done{0};
+    std::thread              poster(
+        [&]
+        {
+            for (std::size_t i = 0; i != count; ++i)
+            {
+                // lets the event loop fall asleep again
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                auto const posted = clock_type::now();
+                B::post(ctx,
+                        [&, i, posted]
+                        {
+                            samples[i] = ns_since(posted);
+                            done.store(i + 1, std::memory_order_release);
+                        });
+                while (done.load(std::memory_order_acquire) != i + 1) std::this_thread::yield();
+            }
+            B::post(ctx, [&] { keep_running.cancel(); });
+        });
+    ctx.run();
+    poster.join();
+    return samples;
+}
+
+template <typename B>
+std::vector<double> timer_delays(std::size_t count)
+{
+    typename B::context    ctx;
+    typename B::timer      t(ctx);
+    std::vector<double>    samples;
+    clock_type::time_point expiry;
+    samples.reserve(count);
+
+    std::function<void()> arm = [&]
+    {
+        expiry = clock_type::now() + std::chrono::microseconds(200);
+        t.expires_at(expiry);
+        t.async_wait(
+            [&](boost::system::error_code ec)
+            {
+                if (ec) return;
+                samples.push_back(ns_since(expiry));
+                if (samples.size() < count) arm();
+            });
+    };
+    arm();
+    ctx.run();
+    return samples;
+}
+
+template <typename B>
+void run_all()
+{
+    auto round_trips = socket_round_trips<B>(20000);
+    report(B::name, "socket round trip", round_trips);
+    auto posts = post_latencies<B>(10000);
+    report(B::name, "cross thread post", posts);
+    auto timers = timer_delays<B>(2000);
+    report(B::name, "timer expiry delay", timers);
+}
+}  // namespace
+
+int main()
+{
+    run_all<asio_backend>();
+    run_all<epoll_backend>();
+}
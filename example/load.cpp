@@ -0,0 +1,498 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Load generator for finding the saturation point of a server. 'load serve' runs a server for the
+// load protocol, 'load run' drives it from several client threads or processes with a mix of method
+// calls and signals and reports throughput and latency percentiles.
+//
+// With --rate the clients run an open loop: requests are sent on a fixed schedule whether or not the
+// server keeps up, and latency is measured from the scheduled send time. Measuring from the actual send
+// time would hide the queueing of a stalled server (coordinated omission). With --rate and --closed a
+// client waits for its outstanding requests before sending the next one, and each latency sample above
+// the send interval is backfilled with the samples the missed sends would have produced. Without
+// --rate the clients send as fast as the replies allow, the latencies then are plain service times.
+
+#include "load.hpp"
+#include <tiny_ipc/client.hpp>
+#include <tiny_ipc/session_manager.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ti = tiny_ipc;
+using namespace ti::literals;
+
+namespace
+{
+using clock_type = std::chrono::steady_clock;
+
+enum operation
+{
+    echo,
+    consume,
+    trigger,
+    operation_count
+};
+constexpr char const* operation_names[operation_count] = {"echo", "consume", "trigger"};
+
+/**
+ * Log-linear latency histogram in nanoseconds: values are bucketed by their highest set bit and the
+ * seven bits below it, which keeps the relative error below 1% over the whole range.
+ */
+struct latency_histogram
+{
+    static constexpr unsigned    sub_bucket_bits = 7;
+    static constexpr uint64_t    sub_buckets     = uint64_t{1} << sub_bucket_bits;
+    static constexpr std::size_t bucket_count    = sub_buckets * (64 - sub_bucket_bits + 1);
+
+    std::array<uint64_t, bucket_count> counts{};
+    uint64_t                           total{0};
+    uint64_t                           max{0};
+
+    static std::size_t index_of(uint64_t value) noexcept
+    {
+        if (value < sub_buckets) return value;
+        unsigned const shift = std::bit_width(value) - sub_bucket_bits - 1;
+        return sub_buckets * (shift + 1) + ((value >> shift) - sub_buckets);
+    }
+    // largest value that falls into the bucket
+    static uint64_t value_of(std::size_t index) noexcept
+    {
+        if (index < sub_buckets) return index;
+        unsigned const shift = index / sub_buckets - 1;
+        return ((index % sub_buckets + sub_buckets + 1) << shift) - 1;
+    }
+
+    void record(uint64_t value) noexcept
+    {
+        ++counts[index_of(value)];
+        ++total;
+        max = std::max(max, value);
+    }
+    // Adds the samples that requests sent on schedule would have seen while this one was stalled.
+    void record_corrected(uint64_t value, uint64_t expected_interval) noexcept
+    {
+        record(value);
+        if (expected_interval == 0) return;
+        for (uint64_t missed = value - std::min(value, expected_interval); missed >= expected_interval; missed -= expected_interval)
+            record(missed);
+    }
+    void merge(latency_histogram const& other) noexcept
+    {
+        for (std::size_t i = 0; i != bucket_count; ++i) counts[i] += other.counts[i];
+        total += other.total;
+        max = std::max(max, other.max);
+    }
+    uint64_t percentile(double p) const noexcept
+    {
+        auto const rank = static_cast<uint64_t>(p / 100.0 * total);
+        uint64_t   seen = 0;
+        for (std::size_t i = 0; i != bucket_count; ++i)
+        {
+            seen += counts[i];
+            if (seen > rank) return std::min(value_of(i), max);
+        }
+        return max;
+    }
+};
+
+// Written by the client processes into a pipe as is, so it has to stay trivially copyable.
+struct results
+{
+    latency_histogram latency[operation_count];
+    uint64_t          completed[operation_count]{};
+    uint64_t          payload_bytes{0};
+    uint64_t          errors{0};
+    uint64_t          unanswered{0};
+};
+
+struct options
+{
+    std::string                           path;
+    std::size_t                           clients{4};
+    bool                                  processes{false};
+    double                                duration{10};
+    std::size_t                           payload{64};
+    std::array<unsigned, operation_count> mix{1, 0, 0};
+    double                                rate{0};  // requests per second and client, 0 sends as fast as replies arrive
+    bool                                  closed{false};
+    std::size_t                           outstanding{1};
+};
+
+auto const load_iface = ti::interface_id("load"_i, "1.0"_v);
+
+/**
+ * One client connection with its own io_context. Requests are issued by pump, either on the schedule
+ * given by the rate or whenever the number of outstanding requests drops below the limit.
+ */
+struct worker
+{
+    options const&                                       opts;
+    results&                                             out;
+    boost::asio::io_context                              io;
+    boost::asio::local::stream_protocol::socket          socket{io};
+    std::optional<ti::client>                            connection;
+    boost::asio::steady_timer                            timer{io};
+    std::string                                          payload;
+    std::unordered_map<uint64_t, clock_type::time_point> triggers;  // sequence number to send time
+    clock_type::duration                                 interval{0};
+    clock_type::time_point                               stop_time;
+    clock_type::time_point                               next_send;
+    uint64_t                                             sequence{0};
+    std::size_t                                          in_flight{0};
+    unsigned                                             mix_position{0};
+    bool                                                 timer_armed{false};
+
+    worker(options const& o, results& r) : opts(o), out(r), payload(o.payload, 'x')
+    {
+        if (opts.rate > 0) interval = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / opts.rate));
+    }
+
+    bool connect()
+    {
+        boost::system::error_code ec;
+        socket.connect(boost::asio::local::stream_protocol::endpoint(opts.path), ec);
+        if (ec) return false;
+        connection.emplace(socket,
+                           [this](boost::system::error_code, ti::client&)
+                           {
+                               ++out.errors;
+                               io.stop();
+                           });
+        ti::async_dispatch_messages<load::load_protocol>(  //
+            *connection,                                   //
+            ti::signals_of("load"_i, "1.0"_v,              //
+                           "triggered"_s = [this](uint64_t token, std::string const& p)
+                           {
+                               auto it = triggers.find(token);
+                               if (it == triggers.end()) return;
+                               auto const sent = it->second;
+                               triggers.erase(it);
+                               complete(trigger, sent, p.size());
+                           }));
+        return true;
+    }
+
+    // weighted round robin over the configured mix
+    operation next_operation()
+    {
+        unsigned position = mix_position++ % (opts.mix[echo] + opts.mix[consume] + opts.mix[trigger]);
+        for (int o = 0; o != operation_count; ++o)
+        {
+            if (position < opts.mix[o]) return static_cast<operation>(o);
+            position -= opts.mix[o];
+        }
+        return echo;
+    }
+
+    void issue(clock_type::time_point sent)
+    {
+        ++in_flight;
+        auto failed = [this](boost::system::error_code)
+        {
+            --in_flight;
+            ++out.errors;
+            pump();
+        };
+        switch (next_operation())
+        {
+            case echo:
+                ti::execute_method<load::load_protocol>(
+                    load_iface, "echo"_m, *connection,
+                    ti::completion{[this, sent](std::string const& reply) { complete(echo, sent, reply.size()); }, failed}, payload);
+                break;
+            case consume:
+                ti::execute_method<load::load_protocol>(load_iface, "consume"_m, *connection,
+                                                        ti::completion{[this, sent](uint32_t size) { complete(consume, sent, size); }, failed},
+                                                        payload);
+                break;
+            default:
+                triggers.emplace(sequence, sent);
+                ti::execute_method<load::load_protocol>(load_iface, "trigger"_m, *connection, [] {}, sequence++, payload);
+                break;
+        }
+    }
+
+    void complete(operation o, clock_type::time_point sent, std::size_t bytes)
+    {
+        auto const now     = clock_type::now();
+        auto const latency = std::chrono::duration_cast<std::chrono::nanoseconds>(now - sent).count();
+        --in_flight;
+        if (opts.closed)
+            out.latency[o].record_corrected(latency, std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count());
+        else
+            out.latency[o].record(latency);
+        ++out.completed[o];
+        out.payload_bytes += bytes;
+        pump();
+    }
+
+    void pump()
+    {
+        auto const now = clock_type::now();
+        if (now >= stop_time)
+        {
+            if (in_flight == 0) io.stop();
+            return;
+        }
+        if (interval == clock_type::duration::zero())
+        {
+            while (in_flight < opts.outstanding) issue(clock_type::now());
+            return;
+        }
+        if (opts.closed)
+        {
+            // a late send goes out immediately and the schedule restarts from there
+            if (in_flight < opts.outstanding && next_send <= now)
+            {
+                issue(now);
+                next_send = std::max(next_send, now) + interval;
+            }
+        }
+        else
+        {
+            for (; next_send <= now; next_send += interval) issue(next_send);
+        }
+        if (!timer_armed && (!opts.closed || in_flight < opts.outstanding)) arm_timer();
+    }
+
+    void arm_timer()
+    {
+        timer_armed = true;
+        timer.expires_at(next_send);
+        timer.async_wait(
+            [this](boost::system::error_code ec)
+            {
+                timer_armed = false;
+                if (!ec) pump();
+            });
+    }
+
+    void run()
+    {
+        auto const start = clock_type::now();
+        stop_time        = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(opts.duration));
+        next_send        = start;
+        pump();
+
+        // requests still unanswered a second after the end are given up
+        boost::asio::steady_timer grace(io, stop_time + std::chrono::seconds(1));
+        grace.async_wait([this](boost::system::error_code ec) { if (!ec) io.stop(); });
+        io.run();
+        out.unanswered += in_flight;
+    }
+};
+
+void run_client(options const& opts, results& out)
+{
+    worker w(opts, out);
+    if (!w.connect())
+    {
+        std::fprintf(stderr, "cannot connect to %s\n", opts.path.c_str());
+        ++out.errors;
+        return;
+    }
+    w.run();
+}
+
+// Runs each client in a forked process, the processes report their results through a pipe.
+bool run_processes(options const& opts, std::vector<results>& all)
+{
+    std::vector<std::pair<pid_t, int>> children;
+    for (auto& r : all)
+    {
+        int channel[2];
+        if (::pipe(channel) != 0) return false;
+        pid_t const pid = ::fork();
+        if (pid < 0) return false;
+        if (pid == 0)
+        {
+            ::close(channel[0]);
+            run_client(opts, r);
+            auto const* data = reinterpret_cast<char const*>(&r);
+            for (std::size_t written = 0; written < sizeof(r);)
+            {
+                auto const n = ::write(channel[1], data + written, sizeof(r) - written);
+                if (n <= 0) ::_exit(1);
+                written += n;
+            }
+            ::_exit(0);
+        }
+        ::close(channel[1]);
+        children.emplace_back(pid, channel[0]);
+    }
+
+    bool complete = true;
+    for (std::size_t i = 0; i != children.size(); ++i)
+    {
+        auto* data = reinterpret_cast<char*>(&all[i]);
+        for (std::size_t read = 0; read < sizeof(results);)
+        {
+            auto const n = ::read(children[i].second, data + read, sizeof(results) - read);
+            if (n <= 0)
+            {
+                complete = false;
+                break;
+            }
+            read += n;
+        }
+        ::close(children[i].second);
+        ::waitpid(children[i].first, nullptr, 0);
+    }
+    return complete;
+}
+
+void print_row(char const* name, latency_histogram const& h, uint64_t completed, double seconds)
+{
+    auto us = [](uint64_t ns) { return ns / 1000.0; };
+    std::printf("%-8s %10llu %12.0f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", name, static_cast<unsigned long long>(completed),
+                completed / seconds, us(h.percentile(50)), us(h.percentile(90)), us(h.percentile(99)), us(h.percentile(99.9)),
+                us(h.percentile(99.99)), us(h.max));
+}
+
+int run_load(options const& opts)
+{
+    std::vector<results> all(opts.clients);
+    auto const           start = clock_type::now();
+    if (opts.processes)
+    {
+        if (!run_processes(opts, all))
+        {
+            std::fprintf(stderr, "lost the results of a client process\n");
+            return 1;
+        }
+    }
+    else
+    {
+        std::vector<std::thread> threads;
+        for (auto& r : all) threads.emplace_back([&opts, &r] { run_client(opts, r); });
+        for (auto& t : threads) t.join();
+    }
+    auto const seconds = std::min(std::chrono::duration<double>(clock_type::now() - start).count(), opts.duration);
+
+    results total;
+    for (auto const& r : all)
+    {
+        for (int o = 0; o != operation_count; ++o)
+        {
+            total.latency[o].merge(r.latency[o]);
+            total.completed[o] += r.completed[o];
+        }
+        total.payload_bytes += r.payload_bytes;
+        total.errors += r.errors;
+        total.unanswered += r.unanswered;
+    }
+
+    std::printf("%zu client %s, %s loop", opts.clients, opts.processes ? "processes" : "threads",
+                opts.rate > 0 && !opts.closed ? "open" : "closed");
+    if (opts.rate > 0) std::printf(" at %.0f requests/s per client", opts.rate);
+    if (opts.rate == 0 || opts.closed) std::printf(", %zu outstanding", opts.outstanding);
+    std::printf(", %zu byte payload, %.1f s\n\n", opts.payload, opts.duration);
+    std::printf("%-8s %10s %12s %9s %9s %9s %9s %9s %9s\n", "", "requests", "requests/s", "p50 us", "p90 us", "p99 us", "p99.9 us",
+                "p99.99 us", "max us");
+
+    latency_histogram all_latencies;
+    uint64_t          all_completed = 0;
+    for (int o = 0; o != operation_count; ++o)
+    {
+        if (opts.mix[o] == 0) continue;
+        print_row(operation_names[o], total.latency[o], total.completed[o], seconds);
+        all_latencies.merge(total.latency[o]);
+        all_completed += total.completed[o];
+    }
+    print_row("all", all_latencies, all_completed, seconds);
+    std::printf("\n%.1f MiB/s payload, %llu errors, %llu unanswered\n", total.payload_bytes / seconds / (1024 * 1024),
+                static_cast<unsigned long long>(total.errors), static_cast<unsigned long long>(total.unanswered));
+    return total.errors == 0 ? 0 : 1;
+}
+
+int serve(std::string const& path)
+{
+    boost::asio::io_context io_ctx;
+    ::unlink(path.c_str());
+    ti::session_manager sessions(io_ctx, boost::asio::local::stream_protocol::endpoint(path),
+                                 [](ti::session_handle, ti::server_session& session)
+                                 {
+                                     ti::async_dispatch_messages<load::load_protocol>(  //
+                                         session,                                       //
+                                         ti::methods_of("load"_i, "1.0"_v,              //
+                                                        "echo"_m    = [](std::string const& p) { return p; },
+                                                        "consume"_m = [](std::string const& p) { return static_cast<uint32_t>(p.size()); },
+                                                        "trigger"_m = [&session](uint64_t token, std::string const& p)
+                                                        { ti::send_signal<load::load_protocol>(load_iface, "triggered"_s, session, token, p); }));
+                                 });
+    boost::asio::signal_set signals(io_ctx, SIGINT, SIGTERM);
+    signals.async_wait([&](boost::system::error_code, int) { io_ctx.stop(); });
+    sessions.start();
+    io_ctx.run();
+    ::unlink(path.c_str());
+    return 0;
+}
+
+int usage()
+{
+    std::printf(
+        "Usage: load serve SOCKET\n"
+        "       load run SOCKET [options]\n"
+        "  --clients N        number of client connections (4)\n"
+        "  --processes        run each client in its own process instead of a thread\n"
+        "  --duration S       seconds to send requests (10)\n"
+        "  --size BYTES       payload bytes per request (64)\n"
+        "  --mix E:C:T        weights of echo, consume and trigger requests (1:0:0)\n"
+        "  --rate R           requests per second and client, sent on schedule (open loop)\n"
+        "  --closed           with --rate, wait for the outstanding requests before sending\n"
+        "  --outstanding K    requests in flight per client in a closed loop (1)\n");
+    return 1;
+}
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) return usage();
+    std::string_view const mode(argv[1]);
+    if (mode == "serve") return serve(argv[2]);
+    if (mode != "run") return usage();
+
+    options opts;
+    opts.path = argv[2];
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string_view const arg(argv[i]);
+        bool const             has_value = i + 1 < argc;
+        if (arg == "--processes")
+            opts.processes = true;
+        else if (arg == "--closed")
+            opts.closed = true;
+        else if (arg == "--clients" && has_value)
+            opts.clients = std::stoul(argv[++i]);
+        else if (arg == "--duration" && has_value)
+            opts.duration = std::stod(argv[++i]);
+        else if (arg == "--size" && has_value)
+            opts.payload = std::stoul(argv[++i]);
+        else if (arg == "--rate" && has_value)
+            opts.rate = std::stod(argv[++i]);
+        else if (arg == "--outstanding" && has_value)
+            opts.outstanding = std::max<std::size_t>(1, std::stoul(argv[++i]));
+        else if (arg == "--mix" && has_value && std::sscanf(argv[++i], "%u:%u:%u", &opts.mix[echo], &opts.mix[consume], &opts.mix[trigger]) == 3)
+            continue;
+        else
+            return usage();
+    }
+    if (opts.mix[echo] + opts.mix[consume] + opts.mix[trigger] == 0 || opts.clients == 0) return usage();
+    return run_load(opts);
+}
@@ -0,0 +1,28 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef LOAD_H_INCLUDED
+#define LOAD_H_INCLUDED
+
+#include <tiny_ipc/proto_def.hpp>
+#include <cstdint>
+#include <string>
+
+namespace load
+{
+namespace ti = tiny_ipc;
+using namespace ti::literals;
+
+constexpr auto load = ti::protocol(                                          //
+    ti::interface("load"_i, "1.0"_v,                                         //
+                  ti::method<std::string(std::string)>("echo"_m),            // replies with the payload
+                  ti::method<uint32_t(std::string)>("consume"_m),            // replies with the payload size
+                  ti::method<void(uint64_t, std::string)>("trigger"_m),      // answered with triggered
+                  ti::signal<void(uint64_t, std::string)>("triggered"_s)));  //
+
+using load_protocol = std::remove_const_t<decltype(load)>;
+
+}  // namespace load
+
+#endif
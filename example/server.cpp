@@ -5,7 +5,7 @@
 #include "chat.hpp"
 #include <algorithm>
 #include <boost/system/error_code.hpp>
-#include <tiny_ipc/server_session.hpp>
+#include <tiny_ipc/session_manager.hpp>
 #include <boost/asio/local/stream_protocol.hpp>
 #include <boost/asio/local/basic_endpoint.hpp>
 #include <boost/asio/completion_condition.hpp>
@@ -14,76 +14,39 @@
 using namespace tiny_ipc::literals;
 struct chat_server
 {
-    boost::asio::io_context&                                                io_ctx;
-    boost::asio::local::basic_endpoint<boost::asio::local::stream_protocol> local;
-    boost::asio::local::stream_protocol::acceptor                           acceptor;
+    tiny_ipc::session_manager sessions;
+    std::vector<std::string>  names;  // indexed by session_handle::index
 
-    struct session_handler
+    chat_server(boost::asio::io_context& ctx, std::string const& path)
+        : sessions(ctx, boost::asio::local::stream_protocol::endpoint(path),
+                   [this](tiny_ipc::session_handle handle, tiny_ipc::server_session& session) { async_read(handle, session); })
     {
-        boost::asio::local::stream_protocol::socket socket;
-        tiny_ipc::server_session                    session;
-        std::string                                 name;
-        template <tiny_ipc::concepts::session_error_handler H>
-        explicit session_handler(boost::asio::local::stream_protocol::socket&& s, H&& h)
-            : socket{std::move(s)}, session(socket, std::forward<H>(h))
-        {
-        }
-    };
-    std::vector<std::shared_ptr<session_handler>> sessions;
-
-    void clear_sessions()
-    {
-        acceptor.close();
-        for (auto& s : sessions) s->session.close();
-        sessions.clear();
     }
-    chat_server(boost::asio::io_context& ctx, std::string const& path) : io_ctx(ctx), local(path.c_str()), acceptor(io_ctx, local) {}
-    void async_read(std::shared_ptr<session_handler> const& c)
+    void clear_sessions() { sessions.stop(); }
+    void async_read(tiny_ipc::session_handle handle, tiny_ipc::server_session& session)
     {
+        if (names.size() <= handle.index) names.resize(handle.index + 1);
+        names[handle.index].clear();
         tiny_ipc::async_dispatch_messages<chat::chat_protocol>(  //
-            c->session,                                          //
+            session,                                             //
 
             tiny_ipc::methods_of(
                 "chat"_i, "1.0"_v,
-                "connect"_m = [this, c](::ucred cred, std::string const& name) -> bool
+                "connect"_m = [this, handle](::ucred cred, std::string const& name) -> bool
                 {
                     std::cout << "The user " << name << " connected, (UID: " << cred.uid << " G:" << cred.gid << " P:" << cred.pid << ")\n";
-                    c->name = name;
+                    names[handle.index] = name;
                     return true;
                 },
                 "send"_m =
-                    [this, c](std::string const& text)
+                    [this, handle](std::string const& text)
                 {
-                    auto msg = c->name + ": " + text;
-                    for (auto& s : sessions)
-                        send_signal<chat::chat_protocol>(tiny_ipc::interface_id("chat"_i, "1.0"_v), "text_added"_s, s->session, msg);
+                    tiny_ipc::broadcast_signal<chat::chat_protocol>(tiny_ipc::interface_id("chat"_i, "1.0"_v), "text_added"_s, sessions,
+                                                                    names[handle.index] + ": " + text);
                 }  //
                 ));
     }
-    void accept_connections()
-    {
-        acceptor.async_accept(local,
-                              [this](boost::system::error_code ec, boost::asio::local::stream_protocol::socket other)
-                              {
-                                  if (ec) { std::cout << "shutting down \n"; }
-                                  else
-                                  {
-                                      sessions.emplace_back(std::make_shared<session_handler>(
-                                          std::move(other),
-                                          [this](boost::system::error_code ec, tiny_ipc::server_session& s) mutable
-                                          {
-                                              sessions.erase(                                     //
-                                                  std::remove_if(begin(sessions), end(sessions),  //
-                                                                 [&s](auto const& item) { return (&s == &item->session); }),
-                                                  end(sessions));
-                                          }));
-
-                                      async_read(sessions.back());
-                                      accept_connections();
-                                  }
-                              });
-    }
-    void start() { accept_connections(); }
+    void start() { sessions.start(); }
 };
 int main(int argc, char** argv)
 {
@@ -0,0 +1,80 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_BUFFER_POOL_H_INCLUDED
+#define TINY_IPC_BUFFER_POOL_H_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <tiny_ipc/detail/protocol.hpp>
+
+namespace tiny_ipc
+{
+/**
+ * Receive buffers for large frames, shared by the sessions of a server, which may run on several
+ * threads. Every buffer lent fits the largest possible frame, so any idle buffer serves any request.
+ * Up to max_idle returned buffers are kept for the next frames, further ones are freed.
+ */
+class buffer_pool
+{
+public:
+    static constexpr std::size_t buffer_size = sizeof(msg_header) + std::numeric_limits<uint16_t>::max();
+
+    explicit buffer_pool(std::size_t max_idle = 16) : max_idle(max_idle) {}
+
+    // Returns a buffer resized to size, with room for buffer_size bytes.
+    std::vector<char> acquire(std::size_t size)
+    {
+        std::vector<char> buffer;
+        {
+            std::lock_guard lock(mutex);
+            if (!idle.empty())
+            {
+                buffer = std::move(idle.back());
+                idle.pop_back();
+            }
+        }
+        buffer.reserve(std::max(size, buffer_size));
+        buffer.resize(size);
+        return buffer;
+    }
+
+    void release(std::vector<char>&& buffer)
+    {
+        std::lock_guard lock(mutex);
+        if (idle.size() < max_idle) idle.push_back(std::move(buffer));
+    }
+
+    std::size_t idle_count() const
+    {
+        std::lock_guard lock(mutex);
+        return idle.size();
+    }
+
+private:
+    mutable std::mutex             mutex;
+    std::vector<std::vector<char>> idle;
+    std::size_t                    max_idle;
+};
+
+/**
+ * How a connection keeps its receive buffer. Frames with a payload above max_payload close the
+ * connection with message_size (EMSGSIZE). Between frames the buffer keeps at most inline_size bytes,
+ * a larger frame is received into a buffer of the pool, or into one allocated for it without a pool,
+ * which is given back once the frame was handled. The default keeps the buffer at the size of the
+ * largest frame received so far.
+ */
+struct receive_policy
+{
+    std::size_t                  max_payload{std::numeric_limits<uint16_t>::max()};
+    std::size_t                  inline_size{std::numeric_limits<std::size_t>::max()};
+    std::shared_ptr<buffer_pool> pool;
+};
+}  // namespace tiny_ipc
+
+#endif
@@ -0,0 +1,131 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_CAPTURE_H_INCLUDED
+#define TINY_IPC_CAPTURE_H_INCLUDED
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace tiny_ipc
+{
+enum class capture_direction : uint8_t
+{
+    received,
+    sent
+};
+
+/**
+ * Precedes each frame in a capture file. The frame follows with its full msg_header and payload, also
+ * after the hello of the handshake switched the connection to the compact header on the socket, so
+ * the frames of a connection after its hello have to be converted to be sent again. File descriptors
+ * and credentials are not stored, only noted.
+ */
+struct capture_record
+{
+    uint64_t          timestamp;    // nanoseconds since the log was opened
+    uint32_t          connection;   // numbered in the order in which connections were attached to the log
+    uint32_t          size;         // bytes of the frame
+    capture_direction direction;
+    uint8_t           fds;          // number of file descriptors passed with the frame
+    uint8_t           credentials;  // 1 when credentials were passed with the frame
+    uint8_t           reserved[5];
+};
+static_assert(sizeof(capture_record) == 24);
+
+constexpr char capture_magic[8] = {'t', 'i', 'p', 'c', 'c', 'a', 'p', '1'};
+
+/**
+ * Binary log of the frames passing through the message_comm instances attached to it with
+ * message_comm::capture_to. Connections of different threads may share one log.
+ */
+struct capture_log
+{
+    explicit capture_log(char const* path) : file(std::fopen(path, "wb")), start(std::chrono::steady_clock::now())
+    {
+        if (file) std::fwrite(capture_magic, sizeof(capture_magic), 1, file);
+    }
+    capture_log(capture_log const&)            = delete;
+    capture_log& operator=(capture_log const&) = delete;
+    ~capture_log()
+    {
+        if (file) std::fclose(file);
+    }
+
+    bool is_open() const noexcept { return file != nullptr; }
+
+    uint32_t add_connection() noexcept
+    {
+        std::lock_guard lock(guard);
+        return connections++;
+    }
+
+    void record(capture_direction direction, uint32_t connection, msghdr const* hdr) noexcept
+    {
+        if (!file) return;
+        capture_record rec{};
+        rec.timestamp  = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        rec.connection = connection;
+        rec.direction  = direction;
+        for (std::size_t i = 0; i != hdr->msg_iovlen; ++i) rec.size += hdr->msg_iov[i].iov_len;
+        auto* msg = const_cast<msghdr*>(hdr);  // CMSG_NXTHDR expects a mutable header
+        for (cmsghdr* control_header = CMSG_FIRSTHDR(msg); control_header; control_header = CMSG_NXTHDR(msg, control_header))
+        {
+            if (control_header->cmsg_type == SCM_RIGHTS) rec.fds += (control_header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            if (control_header->cmsg_type == SCM_CREDENTIALS) rec.credentials = 1;
+        }
+
+        std::lock_guard lock(guard);
+        std::fwrite(&rec, sizeof(rec), 1, file);
+        for (std::size_t i = 0; i != hdr->msg_iovlen; ++i) std::fwrite(hdr->msg_iov[i].iov_base, hdr->msg_iov[i].iov_len, 1, file);
+    }
+
+private:
+    std::mutex                            guard;
+    std::FILE*                            file;
+    std::chrono::steady_clock::time_point start;
+    uint32_t                              connections{0};
+};
+
+// Reads the records of a capture file in the order they were written.
+struct capture_reader
+{
+    explicit capture_reader(char const* path) : file(std::fopen(path, "rb"))
+    {
+        char magic[sizeof(capture_magic)];
+        if (file && (std::fread(magic, sizeof(magic), 1, file) != 1 || std::memcmp(magic, capture_magic, sizeof(magic)) != 0))
+        {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+    capture_reader(capture_reader const&)            = delete;
+    capture_reader& operator=(capture_reader const&) = delete;
+    ~capture_reader()
+    {
+        if (file) std::fclose(file);
+    }
+
+    bool is_open() const noexcept { return file != nullptr; }
+
+    // Returns false at the end of the file or on a truncated record.
+    bool next(capture_record& rec, std::vector<char>& frame)
+    {
+        if (!file || std::fread(&rec, sizeof(rec), 1, file) != 1) return false;
+        frame.resize(rec.size);
+        return rec.size == 0 || std::fread(frame.data(), rec.size, 1, file) == 1;
+    }
+
+private:
+    std::FILE* file;
+};
+}  // namespace tiny_ipc
+
+#endif
@@ -5,17 +5,28 @@
 #ifndef TINY_IPC_CLIENT_H_INCLUDED
 #define TINY_IPC_CLIENT_H_INCLUDED
 #include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <optional>
 #include <ranges>
 #include <vector>
 #include <tiny_ipc/proto_def.hpp>
 #include <tiny_ipc/detail/protocol.hpp>
 #include <tiny_ipc/detail/encode.hpp>
 #include <tiny_ipc/detail/decode.hpp>
+#include <tiny_ipc/detail/batch.hpp>
+#include <tiny_ipc/detail/delta.hpp>
+#include <tiny_ipc/detail/handshake.hpp>
+#include <tiny_ipc/detail/io.hpp>
+#include <tiny_ipc/detail/priority.hpp>
 #include <tiny_ipc/detail/message_comm.hpp>
+#include <tiny_ipc/detail/reply_cache.hpp>
+#include <tiny_ipc/detail/stream.hpp>
+#include <tiny_ipc/detail/timing_wheel.hpp>
 #include <tiny_ipc/detail/to_item.hpp>
 #include <tiny_ipc/detail/forward_item.hpp>
-#include <boost/asio/buffer.hpp>
-#include <boost/asio/read.hpp>
 #include <tiny_tuple/map.h>
 
 namespace tiny_ipc
@@ -32,29 +43,510 @@ concept client_error_handler = requires
 }  // namespace concepts
 
 
+// What execute_method does with a request that would exceed the number of outstanding requests
+enum class overflow_policy
+{
+    queue,          // keep the encoded request locally and send it once a reply frees up a credit
+    back_pressure,  // drop the request and report no_buffer_space (ENOBUFS) to the completion
+    fail_fast       // drop the request, only the return value of execute_method tells
+};
+
+enum class request_status
+{
+    sent,
+    queued,
+    rejected,
+    cached  // answered from the reply cache, nothing was sent
+};
+
+struct flow_control
+{
+    std::size_t     max_outstanding{std::numeric_limits<std::size_t>::max()};
+    overflow_policy on_overflow{overflow_policy::queue};
+};
+
+/**
+ * Bundles a result handler with an error handler, to be passed to execute_method in place of a plain
+ * result handler. on_error is invoked with an error_code when the request could not be completed.
+ * With a timeout the request fails with timed_out (ETIMEDOUT) unless the reply arrives in time.
+ */
+template <typename R, typename E>
+struct completion
+{
+    R                                   on_reply;
+    E                                   on_error;
+    std::chrono::steady_clock::duration timeout{0};  // 0 waits for the reply forever
+};
+template <typename R, typename E>
+completion(R, E) -> completion<R, E>;
+template <typename R, typename E>
+completion(R, E, std::chrono::steady_clock::duration) -> completion<R, E>;
+
+/**
+ * Passed to execute_method in place of a result handler to call a streaming method. on_item is invoked
+ * with each item in order, on_end once after the last item with an empty error_code, or with the error
+ * that ended the stream. Credit for further items is returned to the server as on_item returns, so a
+ * consumer that falls behind holds back the producer.
+ */
+template <typename I, typename E>
+struct stream_completion
+{
+    I on_item;
+    E on_end;
+};
+template <typename I, typename E>
+stream_completion(I, E) -> stream_completion<I, E>;
+
 struct client
 {
     detail::message_comm communicator;
     uint16_t             cookie_generator{0xE0F0};
+    flow_control         limits;
+    std::size_t          server_window{std::numeric_limits<std::size_t>::max()};
 
     struct active_request
     {
-        msg_id                                       id;
-        std::function<void(detail::message_parser&)> payload_handler;
+        msg_id                                                                  id;
+        // invoked with the reply, or with nullptr and the error that ended the request
+        std::function<void(detail::message_parser*, boost::system::error_code)> payload_handler{};
+        detail::timing_wheel<uint16_t>::handle                                  deadline{};
+        uint16_t                                                                stream_window{0};  // 0 unless a streaming call
+        uint16_t                                                                consumed{0};  // stream items since credit was returned
     };
-    std::vector<active_request> active_requests;
+    struct queued_request
+    {
+        active_request request;
+        packet         message;
+        lane           priority;
+    };
+    std::vector<active_request>                    active_requests;
+    std::deque<queued_request>                     queued_requests;  // ordered by lane
+    std::vector<std::pair<uint32_t, std::size_t>>  interface_limits;
+    std::vector<detail::delta_state>               delta_states;
+    detail::timing_wheel<uint16_t>                 deadlines;       // cookies of requests with a timeout
+    std::optional<timer_type>                      deadline_timer;  // created for the first timeout
+    std::chrono::steady_clock::time_point          deadline_timer_expiry{std::chrono::steady_clock::time_point::max()};
+    std::function<void(boost::system::error_code)> on_handshake;  // pending handshake
+    uint64_t                                       handshake_fingerprint{0};
+    detail::reply_cache                            cached_replies;  // of cacheable methods
+    // expires with the client, submission queues use it to detect that the client is gone
+    std::shared_ptr<client*> self{std::make_shared<client*>(this)};
 
     template <c::client_error_handler H>
-    explicit client(boost::asio::local::stream_protocol::socket& s, H on_error) : communicator{s}
+    explicit client(socket_type& s, H on_error, flow_control fc = {}) : communicator{s}, limits{fc}
     {
-        communicator.socket.async_wait(boost::asio::socket_base::wait_error,
+        communicator.socket.async_wait(detail::wait_error,
                                        [this, on_error](boost::system::error_code ec) mutable
                                        {
                                            communicator.socket.close();
-                                           on_error(ec, *this);
+                                           cancel_requests();
+                                           on_error(communicator.receive_error ? communicator.receive_error : ec, *this);
                                        });
     }
     uint16_t gen_cookie() { return cookie_generator++; }
+    // cookie of the request issued last, to be passed to cancel_request
+    uint16_t last_cookie() const noexcept { return cookie_generator - 1; }
+
+    // Completes the active or queued request with operation_aborted, a late reply is dropped.
+    bool cancel_request(uint16_t cookie)
+    {
+        auto request = take_request(cookie);
+        if (!request) return false;
+        deadlines.cancel(request->deadline);
+        if (request->stream_window)
+        {
+            auto cancel = detail::stream_credit_message(request->id, 0);
+            communicator.send(cancel, lane::urgent);
+        }
+        // the handler of a stream is missing while it consumes an item, handle_reply completes it then
+        if (request->payload_handler) request->payload_handler(nullptr, detail::operation_aborted());
+        send_queued();
+        return true;
+    }
+
+    // Completes all active and queued requests with operation_aborted, done on disconnect.
+    void cancel_requests()
+    {
+        std::vector<active_request> requests;
+        requests.swap(active_requests);
+        for (auto& queued : queued_requests) requests.push_back(std::move(queued.request));
+        queued_requests.clear();
+        deadlines.clear();
+        if (deadline_timer) deadline_timer->cancel();
+        deadline_timer_expiry = std::chrono::steady_clock::time_point::max();
+        for (auto& request : requests)
+            if (request.payload_handler) request.payload_handler(nullptr, detail::operation_aborted());
+        if (auto done = std::exchange(on_handshake, nullptr)) done(detail::operation_aborted());
+    }
+
+    // The deadline is kept in a timing wheel, one timer per client wakes up for the earliest deadline.
+    void watch(active_request& request, std::chrono::steady_clock::duration timeout)
+    {
+        if (timeout <= std::chrono::steady_clock::duration::zero()) return;
+        request.deadline = deadlines.insert(std::chrono::steady_clock::now() + timeout, request.id.cookie);
+        arm_deadline_timer();
+    }
+
+    // Restricts the requests in flight for a single interface version in addition to the client wide limit.
+    template <c::interface_id I>
+    void limit_requests(I, std::size_t max_outstanding)
+    {
+        auto it = std::find_if(interface_limits.begin(), interface_limits.end(), [](auto const& l) { return l.first == I::hash; });
+        if (it != interface_limits.end())
+            it->second = max_outstanding;
+        else
+            interface_limits.emplace_back(I::hash, max_outstanding);
+    }
+
+    bool has_credit(uint32_t interface) const noexcept
+    {
+        if (active_requests.size() >= std::min(limits.max_outstanding, server_window)) return false;
+        auto it = std::find_if(interface_limits.begin(), interface_limits.end(), [interface](auto const& l) { return l.first == interface; });
+        return it == interface_limits.end() ||
+               std::count_if(active_requests.begin(), active_requests.end(),
+                             [interface](auto const& r) { return r.id.interface == interface; }) < static_cast<std::ptrdiff_t>(it->second);
+    }
+
+    // Whether requests of the given or a more urgent lane are queued, a call of the lane has to go behind them.
+    bool has_queued_before(lane priority) const noexcept
+    {
+        return !queued_requests.empty() && queued_requests.front().priority <= priority;
+    }
+
+    // Whether a request has to wait for a credit, queued requests of its own or a more urgent lane go first.
+    bool out_of_credit(uint32_t interface, lane priority) const noexcept { return !has_credit(interface) || has_queued_before(priority); }
+
+    // Keeps an encoded request until a credit frees up, queued requests are ordered by lane, so that more
+    // urgent requests get the next credit.
+    void enqueue(active_request request, packet message, lane priority)
+    {
+        auto behind =
+            std::find_if(queued_requests.begin(), queued_requests.end(), [priority](auto const& r) { return r.priority > priority; });
+        queued_requests.insert(behind, {std::move(request), std::move(message), priority});
+    }
+
+    // Sends queued requests in order as long as credits are available. Calls without reply queued behind
+    // them to keep the order need no credit.
+    void send_queued()
+    {
+        while (!queued_requests.empty())
+        {
+            auto&      front   = queued_requests.front();
+            bool const replied = static_cast<bool>(front.request.payload_handler);
+            if (replied && !has_credit(front.request.id.interface)) break;
+            if (replied) active_requests.push_back(std::move(front.request));
+            communicator.send(front.message, front.priority);
+            queued_requests.pop_front();
+        }
+    }
+
+private:
+    std::optional<active_request> take_request(uint16_t cookie)
+    {
+        std::optional<active_request> request;
+        auto active = std::find_if(active_requests.begin(), active_requests.end(), [cookie](auto const& r) { return r.id.cookie == cookie; });
+        if (active != active_requests.end())
+        {
+            request = std::move(*active);
+            active_requests.erase(active);
+            return request;
+        }
+        auto queued = std::find_if(queued_requests.begin(), queued_requests.end(), [cookie](auto const& r) { return r.request.id.cookie == cookie; });
+        if (queued != queued_requests.end())
+        {
+            request = std::move(queued->request);
+            queued_requests.erase(queued);
+        }
+        return request;
+    }
+
+    void arm_deadline_timer()
+    {
+        auto const expiry = deadlines.next_expiry();
+        if (expiry >= deadline_timer_expiry) return;
+        if (!deadline_timer) deadline_timer.emplace(communicator.socket.get_executor());
+        deadline_timer_expiry = expiry;
+        deadline_timer->expires_at(expiry);
+        deadline_timer->async_wait(
+            [this](boost::system::error_code ec)
+            {
+                if (ec) return;
+                deadline_timer_expiry = std::chrono::steady_clock::time_point::max();
+                deadlines.expire(std::chrono::steady_clock::now(),
+                                 [this](uint16_t cookie)
+                                 {
+                                     if (auto request = take_request(cookie)) request->payload_handler(nullptr, detail::timed_out());
+                                 });
+                send_queued();
+                arm_deadline_timer();
+            });
+    }
+};
+
+namespace detail
+{
+template <typename F>
+struct is_completion : std::false_type
+{
+};
+template <typename R, typename E>
+struct is_completion<completion<R, E>> : std::true_type
+{
+};
+
+template <typename F, typename... Ts>
+void invoke_reply_handler(F& f, Ts&&... ts)
+{
+    if constexpr (is_completion<F>::value)
+        f.on_reply(std::forward<Ts>(ts)...);
+    else
+        f(std::forward<Ts>(ts)...);
+}
+
+template <typename F>
+struct is_stream_completion : std::false_type
+{
+};
+template <typename I, typename E>
+struct is_stream_completion<stream_completion<I, E>> : std::true_type
+{
+};
+
+template <typename F>
+void invoke_error_handler(F& f, boost::system::error_code ec)
+{
+    if constexpr (is_completion<F>::value)
+        f.on_error(ec);
+    else if constexpr (is_stream_completion<F>::value)
+        f.on_end(ec);
+}
+
+template <typename F>
+std::chrono::steady_clock::duration timeout_of(F const& f)
+{
+    if constexpr (is_completion<F>::value)
+        return f.timeout;
+    else
+        return std::chrono::steady_clock::duration::zero();
+}
+
+template <typename R, typename F>
+auto make_payload_handler(F&& f)
+{
+    return [handler = std::forward<F>(f)](message_parser* parser, boost::system::error_code ec) mutable
+    {
+        if (!parser) return invoke_error_handler(handler, ec);
+        auto reply = decode_item(*parser, type<R>());
+        if (parser->failed) return invoke_error_handler(handler, protocol_error());
+        invoke_reply_handler(handler, std::move(reply));
+    };
+}
+
+// Like make_payload_handler, but keeps a copy of the decoded reply under the key of the call.
+template <typename R, typename F>
+auto make_caching_payload_handler(client& c, std::string key, std::chrono::steady_clock::duration ttl, F&& f)
+{
+    return [&c, key = std::move(key), ttl, handler = std::forward<F>(f)](message_parser* parser, boost::system::error_code ec) mutable
+    {
+        if (!parser) return invoke_error_handler(handler, ec);
+        auto reply = decode_item(*parser, type<R>());
+        if (parser->failed) return invoke_error_handler(handler, protocol_error());
+        if (!key.empty()) c.cached_replies.insert(std::move(key), ttl, reply);
+        invoke_reply_handler(handler, std::move(reply));
+    };
+}
+
+// Invoked with each item, and with nullptr when the stream ended, the error_code is empty at the regular end.
+template <typename R, typename F>
+auto make_stream_handler(F&& f)
+{
+    return [handler = std::forward<F>(f)](message_parser* parser, boost::system::error_code ec) mutable
+    {
+        if (!parser)
+        {
+            handler.on_end(ec);
+            return;
+        }
+        auto item = decode_item(*parser, type<R>());
+        // a malformed item closes the connection, which ends the stream
+        if (!parser->failed) handler.on_item(std::move(item));
+    };
+}
+
+template <typename Signature, typename R, typename F>
+auto make_reply_handler(client& c, std::string& cache_key, F&& f)
+{
+    if constexpr (is_streaming<Signature>)
+    {
+        static_assert(is_stream_completion<std::decay_t<F>>::value, "streaming methods are called with a stream_completion");
+        return make_stream_handler<R>(std::forward<F>(f));
+    }
+    else if constexpr (is_cacheable<Signature>)
+        return make_caching_payload_handler<R>(c, std::move(cache_key), cache_ttl<Signature>, std::forward<F>(f));
+    else
+        return make_payload_handler<R>(std::forward<F>(f));
+}
+
+inline void handle_control_message(client& c, msg_header const& header, message_parser& msg)
+{
+    switch (header.id.id)
+    {
+        case control::credit_window:
+            c.server_window = decode_item(msg, type<uint16_t>{});
+            c.send_queued();
+            break;
+        case control::hello:
+        {
+            auto done = std::exchange(c.on_handshake, nullptr);
+            if (decode_item(msg, type<uint64_t>{}) == c.handshake_fingerprint)
+            {
+                c.communicator.compact_receive = true;
+                if (done) done({});
+            }
+            else
+            {
+                // the server closes the connection as well
+                if (done) done(protocol_error());
+                c.communicator.socket.close();
+            }
+            break;
+        }
+        case control::invalidate:
+        {
+            auto const prefix = msg.consume_message(msg.message_payload.size());
+            c.cached_replies.invalidate(std::string_view(prefix.data(), prefix.size()));
+            break;
+        }
+        case control::abandoned:
+        {
+            msg_id id;
+            id.interface = decode_item(msg, type<uint32_t>{});
+            id.id        = decode_item(msg, type<uint16_t>{});
+            id.cookie    = decode_item(msg, type<uint16_t>{});
+            auto request =
+                std::find_if(c.active_requests.begin(), c.active_requests.end(), [id](auto const& item) { return item.id == id; });
+            if (request == c.active_requests.end()) break;
+            auto handler = std::move(request->payload_handler);
+            c.deadlines.cancel(request->deadline);
+            c.active_requests.erase(request);
+            if (handler) handler(nullptr, operation_aborted());
+            c.send_queued();
+            break;
+        }
+        default: break;
+    }
+}
+
+// Handles control messages and replies, returns false when msg is a signal.
+inline bool handle_reply(client& c, msg_header const& header, message_parser& msg)
+{
+    if (header.id.interface == control_interface)
+    {
+        handle_control_message(c, header, msg);
+        return true;
+    }
+
+    auto reply_to =
+        std::find_if(c.active_requests.begin(), c.active_requests.end(), [id = header.id](auto const& item) { return item.id == id; });
+    // signals carry the hash of their protocol, a reply without request was cancelled or timed out
+    if (reply_to == c.active_requests.end()) return header.protocol == 0;
+
+    if (reply_to->stream_window && decode_item(msg, type<uint8_t>{}) == stream_item)
+    {
+        // the handler stays with the request, but may issue new requests or cancel the stream meanwhile
+        auto const id      = reply_to->id;
+        auto       handler = std::move(reply_to->payload_handler);
+        handler(&msg, {});
+        reply_to = std::find_if(c.active_requests.begin(), c.active_requests.end(), [id](auto const& item) { return item.id == id; });
+        if (reply_to == c.active_requests.end())
+        {
+            handler(nullptr, operation_aborted());
+            return true;
+        }
+        reply_to->payload_handler = std::move(handler);
+        if (++reply_to->consumed >= std::max(1, reply_to->stream_window / 2))
+        {
+            auto credit = stream_credit_message(id, std::exchange(reply_to->consumed, 0));
+            c.communicator.send(credit, lane::urgent);
+        }
+        return true;
+    }
+
+    // the handler may issue new requests, so release the slot before invoking it
+    auto handler   = std::move(reply_to->payload_handler);
+    bool end_frame = reply_to->stream_window != 0;
+    c.deadlines.cancel(reply_to->deadline);
+    c.active_requests.erase(reply_to);
+    handler(end_frame ? nullptr : &msg, {});
+    c.send_queued();
+    return true;
+}
+
+template <c::protocol P, typename Dispatcher>
+void handle_signal(client& c, msg_header const& header, message_parser& msg, Dispatcher& interface_dispatcher)
+{
+    detail::forward_item<P>(header.id.interface, header.id.id, interface_dispatcher,
+                            [&c, &header, &msg](auto& handler, auto const& signature)
+                            {
+                                using element = std::decay_t<decltype(signature)>;
+                                if constexpr (is_delta_encoded<element>)
+                                {
+                                    auto key = (static_cast<uint64_t>(header.id.interface) << 16) | header.id.id;
+                                    if (!apply_delta(delta_state_of(c.delta_states, key), msg)) return;
+                                }
+                                detail::decode<element>(msg, handler);
+                            });
+}
+
+template <c::protocol P, typename Dispatcher>
+void handle_message(client& c, msg_header const& header, message_parser& msg, Dispatcher& interface_dispatcher)
+{
+    if (!handle_reply(c, header, msg)) handle_signal<P>(c, header, msg, interface_dispatcher);
+}
+
+// Passes a signal to the handlers of the protocol named in its header, signals of other protocols are dropped.
+template <c::protocol_handlers... Hs>
+void route_message(client& c, msg_header const& header, message_parser& msg, Hs&... handlers)
+{
+    if (handle_reply(c, header, msg)) return;
+    (void)((header.protocol == Hs::protocol::hash && (handle_signal<typename Hs::protocol>(c, header, msg, handlers.dispatcher), true)) ||
+           ...);
+}
+}  // namespace detail
+
+/**
+ * Collects method calls into a single frame, which the server answers with a single frame holding
+ * all replies. The calls count towards the outstanding requests of the client, but are not held back
+ * by its flow_control limits. The frame is sent on submit, or on destruction of the batch.
+ */
+struct batch
+{
+    client&                             target;
+    packet                              frame{detail::batch_header()};
+    std::vector<client::active_request> requests;
+    std::size_t                         calls{0};
+
+    explicit batch(client& c) : target(c) {}
+    batch(batch const&)            = delete;
+    batch& operator=(batch const&) = delete;
+    ~batch() { submit(); }
+
+    void submit()
+    {
+        if (calls == 0) return;
+        target.communicator.send(frame);
+        for (auto& request : requests)
+        {
+            // the deadline counts from execute_method and may have passed before the call was sent
+            if (request.deadline.index != detail::timing_wheel<uint16_t>::no_node && !target.deadlines.contains(request.deadline))
+                request.payload_handler(nullptr, detail::timed_out());
+            else
+                target.active_requests.push_back(std::move(request));
+        }
+        requests.clear();
+        calls = 0;
+        frame = packet(detail::batch_header());
+    }
 };
 
 template <c::protocol P, c::signal_group... Ts>
@@ -63,7 +555,7 @@ requires(detail::are_in_protocol<P, typename std::decay_t<Ts>::id, typename std:
 {
     auto default_handler = [&c, ts...]() { async_dispatch_messages<P>(c, ts...); };
     c.communicator.socket.async_wait(
-        boost::asio::socket_base::wait_read,
+        detail::wait_read,
         [&c, default_handler,
          interface_dispatcher =
              tiny_tuple::map<tiny_tuple::detail::item<typename std::decay_t<Ts>::id, decltype(std::decay_t<Ts>::dispatcher)>...>(
@@ -71,53 +563,181 @@ requires(detail::are_in_protocol<P, typename std::decay_t<Ts>::id, typename std:
                      std::move(ts.dispatcher))...)](boost::system::error_code ec) mutable
 
         {
-            if (ec) {}
-            else
+            if (ec) return;  // closed, after the handshake failed for instance
+            if (c.communicator.frame_available())
             {
                 // Consider splitting message receival and consumption into two parts:
-                // Firstly allow asynchronous message handling - i.e. by posting the the resulting invocation and ensuring that the
-                // socket is used strictly synchronously or at least always form a single io_context wake. secondly to allow
-                // handling multiple protocols within a server on a single socket. That way versioning of the protocol could be
-                // achieved by always prefixing the messages with a protocol id, and or splitting up functionalities into multiple
-                // modules might be nicer.
+                // allow asynchronous message handling - i.e. by posting the the resulting invocation and ensuring that the
+                // socket is used strictly synchronously or at least always form a single io_context wake. Multiple protocols
+                // on a single socket are handled by async_dispatch_protocols.
                 auto       msg    = c.communicator.peek_and_receive();
                 msg_header header = decode_item(msg, type<msg_header>{});
 
-                auto item_to_drop = std::remove_if(c.active_requests.begin(), c.active_requests.end(),
-                                                   [id = header.id](auto const& item) { return item.id == id; });
-                if (item_to_drop != c.active_requests.end())  // msg is a reply
-                {
-                    item_to_drop->payload_handler(msg);
-                    c.active_requests.erase(item_to_drop, c.active_requests.end());
-                }
-                else  // msg is a signal
-                {
-                    detail::forward_item<P>(header.id.interface, header.id.id, interface_dispatcher,
-                                            [&msg](auto& handler, auto const& signature)
-                                            { detail::decode<std::decay_t<decltype(signature)>>(msg, handler); });
-                }
+                if (header.id.interface == detail::control_interface && header.id.id == detail::control::batch)
+                    detail::for_each_batched(msg, [&](msg_header const& item, detail::message_parser& item_msg)
+                                             { detail::handle_message<P>(c, item, item_msg, interface_dispatcher); });
+                else
+                    detail::handle_message<P>(c, header, msg, interface_dispatcher);
+                c.communicator.release_frame();
+                if (msg.failed) c.communicator.stop_receiving(detail::protocol_error());
             }
             default_handler();
         });
 }
+/**
+ * Agrees on the protocol with the server: the fingerprint of P covers its interfaces and the names, kinds
+ * and arities of their methods and signals. Frames written after the hello use the compact header,
+ * and so do the frames of the server once it confirmed. on_done is invoked with an empty error_code on
+ * success, or with protocol_error (EPROTO) when the server serves a different protocol and the
+ * connection is closed. Requests may be issued right away, the handshake does not delay them.
+ */
+template <c::protocol P, typename F>
+void handshake(client& c, F&& on_done)
+{
+    packet hello(msg_header{{detail::control_interface, detail::control::hello, 0}, sizeof(uint64_t), 0});
+    encode_item(hello, type<uint64_t>{}, detail::fingerprint<P>);
+    c.on_handshake          = std::forward<F>(on_done);
+    c.handshake_fingerprint = detail::fingerprint<P>;
+    c.communicator.compact  = detail::compact_format::of<P>();
+    c.communicator.send_hello(hello);
+}
+
+/**
+ * Encodes and sends a method call. Methods with a return value occupy a credit until the reply arrives,
+ * when no credit is available the flow_control settings of the client decide what happens with the request.
+ * ResultHandler is either a callable taking the return value or a completion, for streaming methods a
+ * stream_completion. Calls of cacheable methods that have a live reply in the cache of the client are
+ * answered from it, without a round trip.
+ */
 template <c::protocol P, c::interface_id I, c::method_name M, typename ResultHandler, typename... Cs>
 requires detail::is_in_protocol<P, I, M>
-void execute_method(I, M, client& client_instance, ResultHandler&& fun, Cs&&... params)
+request_status execute_method(I, M, client& client_instance, ResultHandler&& fun, Cs&&... params)
 {
     using iface       = get_interface<P, I>;
     using signature   = detail::get_signature<iface, M>;
     using return_type = detail::just_return_type_t<signature>;
     auto cookie       = client_instance.gen_cookie();
     // todo get size hints for control and cred messages..
+    packet new_msg(msg_header{{iface::hash, id_of_item<iface, M>, cookie}, 128, 0, P::hash});
+    constexpr bool cacheable = detail::is_cacheable<signature>;
+    std::string    cache_key;
+    if constexpr (cacheable)
+    {
+        static_assert(!std::is_same_v<void, return_type>, "only methods with a return value can be cacheable");
+        static_assert(!detail::is_streaming<signature>, "streamed replies cannot be cached");
+        // the encoded call is the key, so it is encoded up front
+        detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
+        cache_key = detail::reply_cache::key_of(new_msg);
+        if (auto const* reply = cache_key.empty() ? nullptr : client_instance.cached_replies.template find<return_type>(cache_key))
+        {
+            detail::post(client_instance.communicator.socket.get_executor(),
+                         [handler = std::forward<ResultHandler>(fun), cached = *reply]() mutable
+                         { detail::invoke_reply_handler(handler, std::move(cached)); });
+            return request_status::cached;
+        }
+    }
+    if constexpr (!std::is_same_v<void, return_type>)
+    {
+        constexpr lane priority      = detail::lane_of<signature>;
+        bool const     out_of_credit = client_instance.out_of_credit(iface::hash, priority);
+        if (out_of_credit && client_instance.limits.on_overflow == overflow_policy::back_pressure)
+        {
+            detail::post(client_instance.communicator.socket.get_executor(),
+                         [handler = std::forward<ResultHandler>(fun)]() mutable
+                         { detail::invoke_error_handler(handler, detail::no_buffer_space()); });
+            return request_status::rejected;
+        }
+        if (out_of_credit && client_instance.limits.on_overflow == overflow_policy::fail_fast) return request_status::rejected;
+
+        auto const             timeout = detail::timeout_of(fun);
+        client::active_request request{
+            {iface::hash, id_of_item<iface, M>, cookie},
+            detail::make_reply_handler<signature, return_type>(client_instance, cache_key, std::forward<ResultHandler>(fun))};
+        request.stream_window = detail::stream_window<signature>;
+        client_instance.watch(request, timeout);
+        if (out_of_credit)
+        {
+            if constexpr (!cacheable) detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
+            client_instance.enqueue(std::move(request), std::move(new_msg), priority);
+            return request_status::queued;
+        }
+        client_instance.active_requests.push_back(std::move(request));
+    }
+    else if (client_instance.has_queued_before(detail::lane_of<signature>))
+    {
+        // a call without reply takes no credit, but must not overtake the calls queued before it
+        detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
+        client_instance.enqueue({{iface::hash, id_of_item<iface, M>, cookie}}, std::move(new_msg), detail::lane_of<signature>);
+        return request_status::queued;
+    }
+    if constexpr (!cacheable) detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
+    client_instance.communicator.send(new_msg, detail::lane_of<signature>);
+    return request_status::sent;
+}
+
+/**
+ * Receives the signals of several protocols on one client. Each signal is routed to the handlers of
+ * the protocol named in its header, by comparing it against the protocol hashes known at compile time.
+ */
+template <c::protocol_handlers... Hs>
+requires(sizeof...(Hs) > 0 && detail::are_distinct<Hs::protocol::hash...>) void async_dispatch_protocols(client& c, Hs... handlers)
+{
+    c.communicator.socket.async_wait(
+        detail::wait_read,
+        [&c, handlers...](boost::system::error_code ec) mutable
+        {
+            if (ec) return;
+            if (c.communicator.frame_available())
+            {
+                auto       msg    = c.communicator.peek_and_receive();
+                msg_header header = decode_item(msg, type<msg_header>{});
+                if (header.id.interface == detail::control_interface && header.id.id == detail::control::batch)
+                    detail::for_each_batched(msg, [&](msg_header const& item, detail::message_parser& item_msg)
+                                             { detail::route_message(c, item, item_msg, handlers...); });
+                else
+                    detail::route_message(c, header, msg, handlers...);
+                c.communicator.release_frame();
+                if (msg.failed) c.communicator.stop_receiving(detail::protocol_error());
+            }
+            async_dispatch_protocols(c, std::move(handlers)...);
+        });
+}
+
+// Adds a method call to a batch, the call is sent with the batch. Batched calls bypass the reply cache.
+// A call that does not fit into the 16 bit payload of the frame submits the batch first, a call too large
+// for any batch frame is rejected and its completion fails with message_size (EMSGSIZE).
+template <c::protocol P, c::interface_id I, c::method_name M, typename ResultHandler, typename... Cs>
+requires detail::is_in_protocol<P, I, M>
+request_status execute_method(I, M, batch& batch_instance, ResultHandler&& fun, Cs&&... params)
+{
+    using iface       = get_interface<P, I>;
+    using signature   = detail::get_signature<iface, M>;
+    using return_type = detail::just_return_type_t<signature>;
+    static_assert(!detail::is_streaming<signature>, "streaming methods cannot be batched");
+    msg_id const id{iface::hash, id_of_item<iface, M>, batch_instance.target.gen_cookie()};
+    packet       call(msg_header{id, 128, 0, P::hash});
+    detail::encode<signature>(call, std::forward<Cs>(params)...);
+    if (!detail::append_entry(batch_instance.frame, call))
+    {
+        batch_instance.submit();
+        if (!detail::append_entry(batch_instance.frame, call))
+        {
+            if constexpr (!std::is_same_v<void, return_type>)
+                detail::post(batch_instance.target.communicator.socket.get_executor(),
+                             [handler = std::forward<ResultHandler>(fun)]() mutable
+                             { detail::invoke_error_handler(handler, detail::message_size()); });
+            return request_status::rejected;
+        }
+    }
     if constexpr (!std::is_same_v<void, return_type>)
     {
-        client_instance.active_requests.push_back({{iface::hash, id_of_item<iface, M>, cookie},
-                                                   [handler = std::move(fun)](detail::message_parser& parser)
-                                                   { handler(decode_item(parser, type<return_type>())); }});
+        auto const timeout = detail::timeout_of(fun);
+        batch_instance.requests.push_back({id, detail::make_payload_handler<return_type>(std::forward<ResultHandler>(fun))});
+        batch_instance.target.watch(batch_instance.requests.back(), timeout);
     }
-    packet new_msg(msg_header{{iface::hash, id_of_item<iface, M>, cookie}, 128, 0});
-    detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
-    client_instance.communicator.send(new_msg);
+    ++batch_instance.calls;
+    if (batch_instance.frame.size() > detail::batch_flush_size) batch_instance.submit();
+    return request_status::queued;
 }
 
 }  // namespace tiny_ipc
@@ -0,0 +1,56 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_BATCH_H_INCLUDED
+#define TINY_IPC_DETAIL_BATCH_H_INCLUDED
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <tiny_ipc/detail/protocol.hpp>
+#include <tiny_ipc/detail/packet.hpp>
+#include <tiny_ipc/detail/message_parser.hpp>
+#include <tiny_ipc/detail/decode.hpp>
+
+namespace tiny_ipc::detail
+{
+// Batch frames are flushed once they grow beyond this size, to stay clear of the 16 bit payload size.
+constexpr std::size_t batch_flush_size = 32 * 1024;
+
+inline msg_header batch_header() noexcept { return msg_header{{control_interface, control::batch, 0}, 1024, 0}; }
+
+// Appends an encoded message with its header to a batch frame, together with its file descriptors and
+// credentials. Returns false and leaves the frame untouched when the payload of the frame would exceed
+// the 16 bit payload size, a message that does not even fit into an empty frame cannot be batched.
+inline bool append_entry(packet& frame, packet& message)
+{
+    if (frame.size() - sizeof(msg_header) + message.size() > std::numeric_limits<uint16_t>::max()) return false;
+    uint16_t const payload_size = message.size() - sizeof(msg_header);
+    std::memcpy(message.buffers[0].data() + sizeof(msg_id), &payload_size, sizeof(payload_size));
+    for (auto const& buffer : message.buffers) frame.add_data(buffer);
+    frame.fds.insert(frame.fds.end(), message.fds.begin(), message.fds.end());
+    if (message.creds) frame.add_cred();
+    return true;
+}
+
+// Restricts the parser to each contained message in turn. File descriptors and credentials
+// are shared by all messages of the frame and consumed in order.
+template <typename F>
+void for_each_batched(message_parser& msg, F&& f)
+{
+    while (msg.message_payload.size() >= sizeof(msg_header))
+    {
+        msg_header header   = decode_item(msg, type<msg_header>{});
+        auto const length   = std::min<std::size_t>(header.payload, msg.message_payload.size());
+        auto const rest     = msg.message_payload.subspan(length);
+        msg.message_payload = msg.message_payload.first(length);
+        f(header, msg);
+        if (msg.failed) return;  // the entries after a malformed one are not handled either
+        msg.message_payload = rest;
+    }
+}
+}  // namespace tiny_ipc::detail
+
+#endif
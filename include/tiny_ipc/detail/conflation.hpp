@@ -0,0 +1,89 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_CONFLATION_H_INCLUDED
+#define TINY_IPC_DETAIL_CONFLATION_H_INCLUDED
+
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <tiny_ipc/proto_def.hpp>
+#include <tiny_ipc/detail/serialization_utilities.hpp>
+
+namespace tiny_ipc::detail
+{
+namespace impl
+{
+constexpr std::size_t no_key = std::numeric_limits<std::size_t>::max();
+
+template <typename T>
+struct key_index_of : std::integral_constant<std::size_t, no_key>
+{
+};
+template <std::size_t Index>
+struct key_index_of<conflate_by<Index>> : std::integral_constant<std::size_t, Index>
+{
+};
+
+template <typename Element>
+struct conflation_of
+{
+    static constexpr std::size_t key_index = no_key;
+    static constexpr bool        value     = false;
+};
+template <typename N, typename S, typename... Traits>
+struct conflation_of<tiny_ipc::impl::signal<N, S, Traits...>>
+{
+    static constexpr std::size_t key_index = std::min({no_key, key_index_of<Traits>::value...});
+    static constexpr bool        value     = has_trait<tiny_ipc::impl::signal<N, S, Traits...>, conflate> || key_index != no_key;
+};
+
+template <typename List>
+struct as_tuple;
+template <typename... Ts>
+struct as_tuple<kvasir::mpl::list<Ts...>>
+{
+    using type = std::tuple<Ts...>;
+};
+
+template <typename Param, typename C>
+std::size_t hash_key(C const& value)
+{
+    if constexpr (std::is_same_v<Param, std::string>)
+        return std::hash<std::string_view>{}(std::string_view(value));
+    else
+        return std::hash<Param>{}(static_cast<Param>(value));
+}
+}  // namespace impl
+
+template <typename Element>
+constexpr bool is_conflated = impl::conflation_of<Element>::value;
+
+// Index of the parameter that distinguishes instances of a conflated signal, no_key when there is none.
+template <typename Element>
+constexpr std::size_t conflation_key_index = impl::conflation_of<Element>::key_index;
+
+// Conflation key of a signal with a key parameter, given the value of that parameter alone.
+template <typename Element, typename K>
+uint64_t conflation_key_of(uint32_t interface, uint16_t id, K const& key_param)
+{
+    using param_type = std::tuple_element_t<conflation_key_index<Element>, typename impl::as_tuple<typename impl::to_list<Element>::type>::type>;
+    uint64_t const key = (static_cast<uint64_t>(interface) << 16) | id;
+    return (key ^ impl::hash_key<param_type>(key_param) * 0x9E3779B97F4A7C15ull) | 1;
+}
+
+// Identifies the slot a conflated signal occupies in the send queue of a session.
+template <typename Element, typename... Cs>
+uint64_t conflation_key(uint32_t interface, uint16_t id, Cs const&... params)
+{
+    if constexpr (conflation_key_index<Element> != impl::no_key)
+        return conflation_key_of<Element>(interface, id, std::get<conflation_key_index<Element>>(std::forward_as_tuple(params...)));
+    else
+        return ((static_cast<uint64_t>(interface) << 16) | id) | 1;
+}
+}  // namespace tiny_ipc::detail
+
+#endif
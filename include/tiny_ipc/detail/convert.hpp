@@ -0,0 +1,121 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_CONVERT_H_INCLUDED
+#define TINY_IPC_DETAIL_CONVERT_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace tiny_ipc::detail
+{
+// Element types a contiguous range can be converted between as a whole.
+template <typename T>
+concept convertible_element = std::is_arithmetic_v<T> && !std::is_same_v<std::remove_cv_t<T>, bool>;
+
+namespace impl
+{
+template <typename T, std::size_t Size>
+constexpr bool is_integer_of_size = std::is_integral_v<T> && sizeof(T) == Size;
+
+template <typename To, typename From>
+void convert_scalar(From const* in, std::size_t count, char* out) noexcept
+{
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        To const value = static_cast<To>(in[i]);
+        std::memcpy(out + i * sizeof(To), &value, sizeof(To));
+    }
+}
+
+// Converts the leading elements with SIMD instructions and returns how many of them it did. The
+// float to integer conversions truncate like static_cast, values out of range are undefined there.
+template <typename To, typename From>
+std::size_t convert_block(From const* in, std::size_t count, char* out) noexcept
+{
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    [[maybe_unused]] auto* const outf = reinterpret_cast<float*>(out);
+    [[maybe_unused]] auto* const outd = reinterpret_cast<double*>(out);
+    [[maybe_unused]] auto* const outi = reinterpret_cast<__m128i*>(out);
+#if defined(__AVX__)
+    if constexpr (std::is_same_v<From, double> && std::is_same_v<To, float>)
+        for (; i + 4 <= count; i += 4) _mm_storeu_ps(outf + i, _mm256_cvtpd_ps(_mm256_loadu_pd(in + i)));
+    else if constexpr (std::is_same_v<From, float> && std::is_same_v<To, double>)
+        for (; i + 4 <= count; i += 4) _mm256_storeu_pd(outd + i, _mm256_cvtps_pd(_mm_loadu_ps(in + i)));
+    else if constexpr (std::is_same_v<From, int32_t> && std::is_same_v<To, float>)
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(outf + i, _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(in + i))));
+    else if constexpr (std::is_same_v<From, float> && std::is_same_v<To, int32_t>)
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out) + i / 8, _mm256_cvttps_epi32(_mm256_loadu_ps(in + i)));
+    else if constexpr (std::is_same_v<From, int32_t> && std::is_same_v<To, double>)
+        for (; i + 4 <= count; i += 4) _mm256_storeu_pd(outd + i, _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i))));
+    else if constexpr (std::is_same_v<From, double> && std::is_same_v<To, int32_t>)
+        for (; i + 4 <= count; i += 4) _mm_storeu_si128(outi + i / 4, _mm256_cvttpd_epi32(_mm256_loadu_pd(in + i)));
+#endif
+    if constexpr (std::is_same_v<From, double> && std::is_same_v<To, float>)
+        for (; i + 4 <= count; i += 4) _mm_storeu_ps(outf + i, _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(in + i)), _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2))));
+    else if constexpr (std::is_same_v<From, float> && std::is_same_v<To, double>)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 const v = _mm_loadu_ps(in + i);
+            _mm_storeu_pd(outd + i, _mm_cvtps_pd(v));
+            _mm_storeu_pd(outd + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+        }
+    else if constexpr (std::is_same_v<From, int32_t> && std::is_same_v<To, float>)
+        for (; i + 4 <= count; i += 4) _mm_storeu_ps(outf + i, _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i))));
+    else if constexpr (std::is_same_v<From, float> && std::is_same_v<To, int32_t>)
+        for (; i + 4 <= count; i += 4) _mm_storeu_si128(outi + i / 4, _mm_cvttps_epi32(_mm_loadu_ps(in + i)));
+    else if constexpr (std::is_same_v<From, int32_t> && std::is_same_v<To, double>)
+        for (; i + 2 <= count; i += 2) _mm_storeu_pd(outd + i, _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(in + i))));
+    else if constexpr (std::is_same_v<From, double> && std::is_same_v<To, int32_t>)
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_si128(outi + i / 4, _mm_unpacklo_epi64(_mm_cvttpd_epi32(_mm_loadu_pd(in + i)), _mm_cvttpd_epi32(_mm_loadu_pd(in + i + 2))));
+    else if constexpr (is_integer_of_size<From, 8> && is_integer_of_size<To, 4>)
+        // keeps the low half of each element, as the conversion to an unsigned or since C++20 a signed type does
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 const lo = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i)));
+            __m128 const hi = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i + 2)));
+            _mm_storeu_si128(outi + i / 4, _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))));
+        }
+    else if constexpr (is_integer_of_size<From, 4> && is_integer_of_size<To, 8>)
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i const v    = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+            __m128i const high = std::is_signed_v<From> ? _mm_srai_epi32(v, 31) : _mm_setzero_si128();
+            _mm_storeu_si128(outi + i / 2, _mm_unpacklo_epi32(v, high));
+            _mm_storeu_si128(outi + i / 2 + 1, _mm_unpackhi_epi32(v, high));
+        }
+#else
+    (void)in, (void)count, (void)out;
+#endif
+    return i;
+}
+}  // namespace impl
+
+// Writes count elements of in converted to To to the possibly unaligned out, with the result of static_cast.
+template <convertible_element To, convertible_element From>
+void convert_elements(From const* in, std::size_t count, char* out) noexcept
+{
+    using from_type = std::remove_cv_t<From>;
+    using to_type   = std::remove_cv_t<To>;
+    if constexpr (std::is_same_v<from_type, to_type>)
+        std::memcpy(out, in, count * sizeof(to_type));
+    else
+    {
+        std::size_t const done = impl::convert_block<to_type, from_type>(in, count, out);
+        impl::convert_scalar<to_type>(in + done, count - done, out + done * sizeof(to_type));
+    }
+}
+}  // namespace tiny_ipc::detail
+
+#endif
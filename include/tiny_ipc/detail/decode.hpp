@@ -7,8 +7,16 @@
 
 #include <tiny_ipc/detail/message_parser.hpp>
 #include <tiny_ipc/detail/serialization_utilities.hpp>
+#include <tiny_ipc/detail/reflection.hpp>
+#include <array>
 #include <limits>
+#include <map>
+#include <optional>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <variant>
 
 namespace tiny_ipc
 {
@@ -17,9 +25,9 @@ template <typename T>
 requires is_trivially_serializable_v<T> inline T decode_item(detail::message_parser& msg, type<T>)
 {
     // alternatively if we guarantee alignment we could decode by casting - but then there is a dependency on ABI
-    T    ret;
+    T    ret{};
     auto data = msg.consume_message(sizeof(ret));
-    std::memcpy(&ret, data.data(), data.size());
+    if (!data.empty()) std::memcpy(&ret, data.data(), sizeof(ret));
     return ret;
 }
 
@@ -36,6 +44,24 @@ inline ucred decode_item(detail::message_parser& msg, type<ucred>)
 
 inline fd decode_item(detail::message_parser& msg, type<fd>) { return msg.consume_fd(); }
 
+inline file_slice decode_item(detail::message_parser& msg, type<file_slice>)
+{
+    auto file   = msg.consume_fd();
+    auto offset = decode_item(msg, type<uint64_t>{});
+    return file_slice(std::move(file), offset, decode_item(msg, type<uint64_t>{}));
+}
+
+// maps the buffer through the process wide mapping cache, empty when it cannot hold the elements
+template <typename T>
+inline shared_buffer<T> decode_item(detail::message_parser& msg, type<shared_buffer<T>>)
+{
+    auto       file  = msg.consume_fd();
+    auto const count = decode_item(msg, type<uint64_t>{});
+    auto       region = detail::mapping_cache::instance().map(std::move(file));
+    if (!region || count > region->size / sizeof(T)) return {};
+    return shared_buffer<T>(std::move(region), static_cast<std::size_t>(count));
+}
+
 template <typename T>
 inline std::vector<T> decode_item(detail::message_parser& msg, type<std::vector<T>>)
 {
@@ -49,29 +75,285 @@ inline std::vector<T> decode_item(detail::message_parser& msg, type<std::vector<
 inline std::string decode_item(detail::message_parser& msg, type<std::string>)
 {
     auto length = decode_item(msg, type<uint16_t>{});
-    return std::string(msg.consume_message(length).data(), length);
+    auto data   = msg.consume_message(length);
+    return std::string(data.data(), data.size());
 }
 
 inline std::string_view decode_item(detail::message_parser& msg, type<std::string_view>)
 {
     auto length = decode_item(msg, type<uint16_t>{});
-    return std::string_view(msg.consume_message(length).data(), length);
+    auto data   = msg.consume_message(length);
+    return std::string_view(data.data(), data.size());
 }
 
 inline char const* decode_item(detail::message_parser& msg, type<char const*>)
 {
     auto length = decode_item(msg, type<uint16_t>{});
-    return msg.consume_message(length).data();
+    auto data   = msg.consume_message(length);
+    return msg.failed ? "" : data.data();
+}
+template <typename T>
+inline std::optional<T> decode_item(detail::message_parser& msg, type<std::optional<T>>)
+{
+    if (decode_item(msg, type<uint8_t>{})) return decode_item(msg, type<T>{});
+    return std::nullopt;
+}
+
+namespace detail
+{
+template <typename Variant, typename T, std::size_t I>
+Variant decode_alternative(detail::message_parser& msg)
+{
+    return Variant(std::in_place_index<I>, decode_item(msg, type<T>{}));
+}
+
+template <typename... Ts, std::size_t... I>
+std::variant<Ts...> decode_variant(detail::message_parser& msg, std::size_t index, std::index_sequence<I...>)
+{
+    using decoder                       = std::variant<Ts...> (*)(detail::message_parser&);
+    static constexpr decoder decoders[] = {&decode_alternative<std::variant<Ts...>, Ts, I>...};
+    if (index < sizeof...(Ts)) return decoders[index](msg);
+    // the size of an unknown alternative is unknown as well, so nothing after it can be decoded
+    msg.fail();
+    if constexpr (std::is_default_constructible_v<std::variant<Ts...>>) return std::variant<Ts...>{};
+    return decoders[0](msg);
+}
+}  // namespace detail
+
+template <typename... Ts>
+inline std::variant<Ts...> decode_item(detail::message_parser& msg, type<std::variant<Ts...>>)
+{
+    auto index = decode_item(msg, type<uint8_t>{});
+    return detail::decode_variant<Ts...>(msg, index, std::index_sequence_for<Ts...>{});
+}
+
+template <typename T, std::size_t N>
+requires(!is_trivially_serializable_v<std::array<T, N>>) inline std::array<T, N> decode_item(detail::message_parser& msg, type<std::array<T, N>>)
+{
+    std::array<T, N> ret;
+    for (auto& item : ret) item = decode_item(msg, type<T>{});
+    return ret;
+}
+
+template <typename... Ts>
+inline std::tuple<Ts...> decode_item(detail::message_parser& msg, type<std::tuple<Ts...>>)
+{
+    return std::tuple<Ts...>{decode_item(msg, type<Ts>{})...};
+}
+
+template <typename A, typename B>
+inline std::pair<A, B> decode_item(detail::message_parser& msg, type<std::pair<A, B>>)
+{
+    A first = decode_item(msg, type<A>{});
+    return std::pair<A, B>(std::move(first), decode_item(msg, type<B>{}));
 }
+
+template <typename K, typename V>
+inline std::map<K, V> decode_item(detail::message_parser& msg, type<std::map<K, V>>)
+{
+    auto           map_size = decode_item(msg, type<uint16_t>{});
+    std::map<K, V> ret;
+    for (int i = 0; i != map_size; ++i)
+    {
+        K key = decode_item(msg, type<K>{});
+        ret.emplace_hint(ret.end(), std::move(key), decode_item(msg, type<V>{}));
+    }
+    return ret;
+}
+
+template <typename K, typename V>
+inline std::unordered_map<K, V> decode_item(detail::message_parser& msg, type<std::unordered_map<K, V>>)
+{
+    auto                     map_size = decode_item(msg, type<uint16_t>{});
+    std::unordered_map<K, V> ret;
+    ret.reserve(map_size);
+    for (int i = 0; i != map_size; ++i)
+    {
+        K key = decode_item(msg, type<K>{});
+        ret.emplace(std::move(key), decode_item(msg, type<V>{}));
+    }
+    return ret;
+}
+
+namespace detail
+{
+template <typename Fields, std::size_t... I>
+void decode_fields(detail::message_parser& msg, Fields fields, std::index_sequence<I...>)
+{
+    // mirrors encode_fields: consecutive trivially serializable fields are copied at once
+    char*       run_begin = nullptr;
+    std::size_t run_size  = 0;
+    auto        flush     = [&]()
+    {
+        auto data = msg.consume_message(run_size);
+        if (!data.empty()) std::memcpy(run_begin, data.data(), run_size);
+        run_size = 0;
+    };
+    (
+        [&]()
+        {
+            auto& field      = std::get<I>(fields);
+            using field_type = std::decay_t<decltype(field)>;
+            if constexpr (is_trivially_serializable_v<field_type>)
+            {
+                auto* bytes = static_cast<char*>(static_cast<void*>(&field));
+                if (run_size && run_begin + run_size == bytes)
+                    run_size += sizeof(field_type);
+                else
+                {
+                    flush();
+                    run_begin = bytes;
+                    run_size  = sizeof(field_type);
+                }
+            }
+            else
+            {
+                flush();
+                field = decode_item(msg, type<field_type>{});
+            }
+        }(),
+        ...);
+    flush();
+}
+}  // namespace detail
+
+// Aggregates are decoded field by field, unless there is a more specific overload.
+template <detail::reflectable T>
+inline T decode_item(detail::message_parser& msg, type<T>)
+{
+    static_assert(std::is_default_constructible_v<T>, "aggregates are decoded in place and need to be default constructible");
+    T    ret{};
+    auto fields = detail::tie_fields(ret);
+    detail::decode_fields(msg, fields, std::make_index_sequence<std::tuple_size_v<decltype(fields)>>{});
+    return ret;
+}
+
+// Moves the parser past an item without materializing it. Overload this function for user types
+// with a cheaper way than decoding them.
+template <typename T>
+inline void skip_item(detail::message_parser& msg, type<T>)
+{
+    if constexpr (is_trivially_serializable_v<T>)
+        msg.consume_message(sizeof(T));
+    else
+        (void)decode_item(msg, type<T>{});
+}
+
+inline void skip_item(detail::message_parser&, type<ucred>) {}
+
+template <typename T>
+inline void skip_item(detail::message_parser& msg, type<shared_buffer<T>>)
+{
+    msg.consume_fd();
+    msg.consume_message(sizeof(uint64_t));
+}
+
+inline void skip_item(detail::message_parser& msg, type<std::string>) { msg.consume_message(decode_item(msg, type<uint16_t>{})); }
+
+template <typename T>
+inline void skip_item(detail::message_parser& msg, type<std::vector<T>>)
+{
+    auto vec_size = decode_item(msg, type<uint16_t>{});
+    if constexpr (is_trivially_serializable_v<T>)
+        msg.consume_message(vec_size * sizeof(T));
+    else
+        for (int i = 0; i != vec_size; ++i) skip_item(msg, type<T>{});
+}
+
+template <typename T>
+inline void skip_item(detail::message_parser& msg, type<std::optional<T>>)
+{
+    if (decode_item(msg, type<uint8_t>{})) skip_item(msg, type<T>{});
+}
+
+/**
+ * Handlers taking a message_view instead of the parameters of the signature decode parameters on
+ * demand. Parameters in front of the requested one are skipped without being materialized.
+ * The view refers to the received message and must not outlive the handler invocation.
+ */
+template <typename... Params>
+struct message_view
+{
+    static constexpr std::size_t size = sizeof...(Params);
+
+    explicit message_view(detail::message_parser& parser) : msg(parser), payload(parser.message_payload), first_fd(parser.consumed_fds) {}
+
+    // Decodes the parameter at Index, optionally into a different type with a compatible encoding, i.e. std::string_view.
+    template <std::size_t Index, typename As = std::tuple_element_t<Index, std::tuple<Params...>>>
+    As get()
+    {
+        static_assert(Index < size, "parameter index out of range");
+        seek(Index);
+        return decode_item(msg, type<As>{});
+    }
+
+private:
+    detail::message_parser&           msg;
+    std::span<char>                   payload;
+    std::size_t                       first_fd;
+    std::array<std::size_t, size + 1> offsets{};     // byte offset of each parameter in payload, valid up to known
+    std::array<std::size_t, size + 1> fd_offsets{};  // file descriptors used by the parameters in front
+    std::size_t                       known{1};
+
+    template <typename T>
+    static void skip(detail::message_parser& parser)
+    {
+        skip_item(parser, type<T>{});
+    }
+
+    void seek(std::size_t index)
+    {
+        using skipper                       = void (*)(detail::message_parser&);
+        static constexpr skipper skippers[] = {&skip<Params>...};
+        for (; known <= index; ++known)
+        {
+            position(known - 1);
+            skippers[known - 1](msg);
+            offsets[known]    = payload.size() - msg.message_payload.size();
+            fd_offsets[known] = msg.consumed_fds - first_fd;
+        }
+        position(index);
+    }
+
+    void position(std::size_t index)
+    {
+        msg.message_payload = payload.subspan(offsets[index]);
+        msg.consumed_fds    = first_fd + fd_offsets[index];
+    }
+};
+
 namespace detail
 {
 namespace impl
 {
+// True for handlers that take a message_view, generic callables are never considered, their body
+// would have to be instantiated to tell.
+template <typename F, typename View>
+constexpr bool takes_view = []()
+{
+    if constexpr (requires { &std::decay_t<F>::operator(); } || std::is_pointer_v<std::decay_t<F>>)
+        return std::is_invocable_v<F&, View&>;
+    else
+        return false;
+}();
+
 template <typename... ListItems, typename F>
-inline decltype(std::declval<F>()(std::declval<ListItems>()...)) decode_items(detail::message_parser& msg, kvasir::mpl::list<ListItems...>,
-                                                                       F&&                     fun)
+inline decltype(auto) decode_items(detail::message_parser& msg, kvasir::mpl::list<ListItems...>, F&& fun)
 {
-    return fun(decode_item(msg, type<ListItems>{})...);
+    if constexpr (takes_view<F, message_view<ListItems...>>)
+    {
+        message_view<ListItems...> view(msg);
+        return fun(view);
+    }
+    else
+    {
+        // braced initialization is the only way to guarantee left to right evaluation of the parameters
+        std::tuple<ListItems...> params{decode_item(msg, type<ListItems>{})...};
+        using result = decltype(std::apply(std::forward<F>(fun), std::move(params)));
+        if constexpr (std::is_void_v<result> || std::is_default_constructible_v<result>)
+            if (msg.failed) return result();  // the handler never sees a malformed call
+        return std::apply(std::forward<F>(fun), std::move(params));
+    }
 }
 }  // namespace impl
 
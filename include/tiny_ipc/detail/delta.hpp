@@ -0,0 +1,164 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_DELTA_H_INCLUDED
+#define TINY_IPC_DETAIL_DELTA_H_INCLUDED
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <vector>
+#include <tiny_ipc/proto_def.hpp>
+#include <tiny_ipc/detail/packet.hpp>
+#include <tiny_ipc/detail/message_parser.hpp>
+#include <tiny_ipc/detail/decode.hpp>
+
+namespace tiny_ipc::detail
+{
+namespace impl
+{
+template <typename T>
+struct full_every_of : std::integral_constant<std::size_t, 0>
+{
+};
+template <std::size_t FullEvery>
+struct full_every_of<delta_encoded<FullEvery>> : std::integral_constant<std::size_t, FullEvery>
+{
+};
+
+template <typename Element>
+struct delta_of : std::integral_constant<std::size_t, 0>
+{
+};
+template <typename N, typename S, typename... Traits>
+struct delta_of<tiny_ipc::impl::signal<N, S, Traits...>> : std::integral_constant<std::size_t, std::max({std::size_t{0}, full_every_of<Traits>::value...})>
+{
+};
+}  // namespace impl
+
+template <typename Element>
+constexpr bool is_delta_encoded = impl::delta_of<Element>::value != 0;
+template <typename Element>
+constexpr std::size_t full_snapshot_interval = impl::delta_of<Element>::value;
+
+// The payload of a delta encoded signal starts with one of these, followed by either the complete
+// payload, or by (uint16_t offset, uint16_t length, bytes) ranges that changed since the last message.
+enum class delta_kind : uint8_t
+{
+    full  = 0,
+    delta = 1
+};
+
+struct delta_state
+{
+    uint64_t          key;
+    std::vector<char> last;
+    std::size_t       since_full{0};
+};
+
+inline delta_state& delta_state_of(std::vector<delta_state>& states, uint64_t key)
+{
+    auto it = std::find_if(states.begin(), states.end(), [key](delta_state const& s) { return s.key == key; });
+    if (it != states.end()) return *it;
+    return states.emplace_back(delta_state{key, {}, 0});
+}
+
+// Ranges closer than this are merged, a range header costs as much as a few unchanged bytes.
+constexpr std::size_t delta_merge_gap = 2 * sizeof(uint16_t);
+
+/**
+ * Writes the payload of encoded, relative to the state of the receiving session, into out and
+ * updates state. Falls back to a full snapshot when the size changed, the snapshot interval
+ * elapsed or the difference would not be smaller than the payload.
+ */
+inline void encode_delta(delta_state& state, std::size_t full_every, packet& encoded, packet& out)
+{
+    std::vector<char> current;
+    current.reserve(encoded.size());
+    for (auto const& buf : encoded.buffers) current.insert(current.end(), buf.begin(), buf.end());
+    current.erase(current.begin(), current.begin() + sizeof(msg_header));
+
+    bool full = state.last.size() != current.size() || ++state.since_full >= full_every;
+    if (!full)
+    {
+        std::vector<char> ranges;
+        for (std::size_t pos = 0; pos < current.size();)
+        {
+            auto mismatch =
+                std::mismatch(current.begin() + pos, current.end(), state.last.begin() + pos).first - current.begin();
+            if (static_cast<std::size_t>(mismatch) == current.size()) break;
+            std::size_t end = mismatch, unchanged = 0;
+            for (std::size_t i = mismatch; i != current.size() && unchanged <= delta_merge_gap; ++i)
+            {
+                if (current[i] != state.last[i])
+                {
+                    end       = i + 1;
+                    unchanged = 0;
+                }
+                else
+                    ++unchanged;
+            }
+            uint16_t const offset = mismatch, length = end - mismatch;
+            ranges.insert(ranges.end(), reinterpret_cast<char const*>(&offset), reinterpret_cast<char const*>(&offset) + sizeof(offset));
+            ranges.insert(ranges.end(), reinterpret_cast<char const*>(&length), reinterpret_cast<char const*>(&length) + sizeof(length));
+            ranges.insert(ranges.end(), current.begin() + mismatch, current.begin() + end);
+            pos = end;
+        }
+        if (ranges.size() >= current.size())
+            full = true;
+        else
+        {
+            encode_item(out, type<delta_kind>{}, delta_kind::delta);
+            out.add_data(ranges);
+        }
+    }
+    if (full)
+    {
+        encode_item(out, type<delta_kind>{}, delta_kind::full);
+        out.add_data(current);
+        state.since_full = 0;
+    }
+    state.last = std::move(current);
+}
+
+/**
+ * Rebuilds the complete payload of a delta encoded signal in state and points the parser at it.
+ * Returns false when the message cannot be applied, i.e. when the preceding snapshot is missing. A malformed
+ * delta also drops the snapshot and fails the parser.
+ */
+inline bool apply_delta(delta_state& state, message_parser& msg)
+{
+    auto kind = decode_item(msg, type<delta_kind>{});
+    if (kind == delta_kind::full)
+        state.last.assign(msg.message_payload.begin(), msg.message_payload.end());
+    else
+    {
+        if (state.last.empty()) return false;
+        while (msg.message_payload.size() >= 2 * sizeof(uint16_t))
+        {
+            auto offset = decode_item(msg, type<uint16_t>{});
+            auto length = decode_item(msg, type<uint16_t>{});
+            if (offset + length > state.last.size() || length > msg.message_payload.size())
+            {
+                state.last.clear();
+                msg.fail();
+                return false;
+            }
+            auto data = msg.consume_message(length);
+            std::memcpy(state.last.data() + offset, data.data(), length);
+        }
+        if (!msg.message_payload.empty())
+        {
+            // a truncated range header, the snapshot may already be half patched
+            state.last.clear();
+            msg.fail();
+            return false;
+        }
+    }
+    msg.message_payload = std::span<char>(state.last.data(), state.last.size());
+    return true;
+}
+}  // namespace tiny_ipc::detail
+
+#endif
@@ -5,7 +5,16 @@
 #ifndef TINY_IPC_DETAIL_ENCODE_H_INCLUDED
 #define TINY_IPC_DETAIL_ENCODE_H_INCLUDED
 
+#include <map>
+#include <optional>
+#include <ranges>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <variant>
 #include <tiny_ipc/detail/serialization_utilities.hpp>
+#include <tiny_ipc/detail/convert.hpp>
+#include <tiny_ipc/detail/reflection.hpp>
 #include <tiny_ipc/detail/packet.hpp>
 
 namespace tiny_ipc
@@ -22,7 +31,7 @@ requires(is_trivially_serializable_v<U> && !std::is_same_v<std::decay_t<U>, std:
                                                                                                                T&&     param)
 {
     U temp = std::forward<T>(param);
-    encoded_msg.add_data({&temp, sizeof(temp)});
+    encoded_msg.add_data(std::span<char const>(static_cast<char const*>(static_cast<void const*>(&temp)), sizeof(temp)));
 }
 
 template <typename T>
@@ -31,24 +40,68 @@ void encode_item(packet& encoded_msg, type<::ucred>, T&& param)
     encoded_msg.add_cred();
 }
 
+namespace detail
+{
+template <typename Container>
+using element_of = std::remove_cv_t<std::ranges::range_value_t<Container>>;
+
+// Contiguous elements are written as a single block, copied when they already have the type on the wire
+// or converted all at once between arithmetic types.
+template <typename T, typename Container>
+concept block_encodable = std::ranges::contiguous_range<Container> &&
+                          ((is_trivially_serializable_v<T> && std::is_same_v<T, element_of<Container>>) ||
+                           (convertible_element<T> && convertible_element<element_of<Container>>));
+
+template <typename T, typename Container>
+void encode_elements(packet& encoded_msg, Container const& param)
+{
+    if constexpr (block_encodable<T, Container>)
+    {
+        auto const count = std::ranges::size(param);
+        auto       part  = encoded_msg.reserve_data(count * sizeof(T));
+        if constexpr (std::is_same_v<T, element_of<Container>>)
+            std::memcpy(part.data(), std::ranges::data(param), part.size());
+        else
+            convert_elements<T>(std::ranges::data(param), count, part.data());
+    }
+    else
+        for (auto const& item : param) encode_item(encoded_msg, type<T>{}, item);
+}
+}  // namespace detail
+
 template <typename T, typename Container>
 void encode_item(packet& encoded_msg, type<std::vector<T>>, Container&& param)
 {
     encode_item(encoded_msg, type<uint16_t>{}, param.size());
-    for (auto const& item : param) encode_item(encoded_msg, type<T>{}, item);
+    detail::encode_elements<T>(encoded_msg, param);
 }
 
 template <typename T, typename Container>
 void encode_item(packet& encoded_msg, type<std::span<T>>, Container&& param)
 {
     encode_item(encoded_msg, type<uint16_t>{}, param.size());
-    for (auto const& item : param) encode_item(encoded_msg, type<T>{}, item);
+    detail::encode_elements<std::remove_cv_t<T>>(encoded_msg, param);
 }
 
 template <typename T>
 void encode_item(packet& encoded_msg, type<fd>, T&& param)
 {
-    encoded_msg.add_fd(std::forward<fd>(param));
+    encoded_msg.add_fd(static_cast<int>(param));
+}
+
+// the descriptor goes with SCM_RIGHTS, offset and length with the payload
+inline void encode_item(packet& encoded_msg, type<file_slice>, file_slice const& param)
+{
+    encoded_msg.add_fd(static_cast<int>(param.file));
+    encode_item(encoded_msg, type<uint64_t>{}, param.offset);
+    encode_item(encoded_msg, type<uint64_t>{}, param.length);
+}
+
+template <typename T>
+void encode_item(packet& encoded_msg, type<shared_buffer<T>>, shared_buffer<T> const& param)
+{
+    encoded_msg.add_fd(static_cast<int>(param.file()));
+    encode_item(encoded_msg, type<uint64_t>{}, static_cast<uint64_t>(param.size()));
 }
 
 inline void encode_item(packet& encoded_msg, type<std::string>, std::string const& param)
@@ -74,6 +127,129 @@ inline void encode_item(packet& encoded_msg, type<std::string>, std::string_view
     mempcpy(part.data(), &length, sizeof(length));
     mempcpy(part.data() + sizeof(length), param.data(), length);
 }
+template <typename T, typename U>
+void encode_item(packet& encoded_msg, type<std::optional<T>>, U&& param)
+{
+    if constexpr (std::is_same_v<std::decay_t<U>, std::nullopt_t>)
+        encode_item(encoded_msg, type<uint8_t>{}, uint8_t{0});
+    else if constexpr (requires { param.has_value(); })
+    {
+        encode_item(encoded_msg, type<uint8_t>{}, static_cast<uint8_t>(param.has_value()));
+        if (param) encode_item(encoded_msg, type<T>{}, *std::forward<U>(param));
+    }
+    else
+    {
+        encode_item(encoded_msg, type<uint8_t>{}, uint8_t{1});
+        encode_item(encoded_msg, type<T>{}, std::forward<U>(param));
+    }
+}
+
+template <typename... Ts, typename U>
+void encode_item(packet& encoded_msg, type<std::variant<Ts...>>, U&& param)
+{
+    static_assert(sizeof...(Ts) <= 256, "variant index has to fit into a single byte");
+    if constexpr (requires { param.index(); })
+    {
+        encode_item(encoded_msg, type<uint8_t>{}, static_cast<uint8_t>(param.index()));
+        std::visit([&encoded_msg](auto const& alternative)
+                   { encode_item(encoded_msg, type<std::decay_t<decltype(alternative)>>{}, alternative); },
+                   param);
+    }
+    else
+        encode_item(encoded_msg, type<std::variant<Ts...>>{}, std::variant<Ts...>(std::forward<U>(param)));
+}
+
+// arrays of trivially serializable types are trivially serializable themselves, this covers the rest
+template <typename T, std::size_t N, typename U>
+void encode_item(packet& encoded_msg, type<std::array<T, N>>, U&& param)
+{
+    for (auto const& item : param) encode_item(encoded_msg, type<T>{}, item);
+}
+
+template <typename... Ts, typename U>
+void encode_item(packet& encoded_msg, type<std::tuple<Ts...>>, U&& param)
+{
+    std::apply([&encoded_msg](auto const&... items) { (encode_item(encoded_msg, type<Ts>{}, items), ...); }, param);
+}
+
+template <typename A, typename B, typename U>
+void encode_item(packet& encoded_msg, type<std::pair<A, B>>, U&& param)
+{
+    encode_item(encoded_msg, type<A>{}, param.first);
+    encode_item(encoded_msg, type<B>{}, param.second);
+}
+
+template <typename K, typename V, typename U>
+void encode_item(packet& encoded_msg, type<std::map<K, V>>, U&& param)
+{
+    encode_item(encoded_msg, type<uint16_t>{}, param.size());
+    for (auto const& [key, value] : param)
+    {
+        encode_item(encoded_msg, type<K>{}, key);
+        encode_item(encoded_msg, type<V>{}, value);
+    }
+}
+
+template <typename K, typename V, typename U>
+void encode_item(packet& encoded_msg, type<std::unordered_map<K, V>>, U&& param)
+{
+    encode_item(encoded_msg, type<uint16_t>{}, param.size());
+    for (auto const& [key, value] : param)
+    {
+        encode_item(encoded_msg, type<K>{}, key);
+        encode_item(encoded_msg, type<V>{}, value);
+    }
+}
+
+namespace detail
+{
+template <typename Fields, std::size_t... I>
+void encode_fields(packet& encoded_msg, Fields const& fields, std::index_sequence<I...>)
+{
+    // consecutive trivially serializable fields without padding in between are copied at once
+    char const* run_begin = nullptr;
+    std::size_t run_size  = 0;
+    auto        flush     = [&]()
+    {
+        if (run_size) encoded_msg.add_data(std::span<char const>(run_begin, run_size));
+        run_size = 0;
+    };
+    (
+        [&]()
+        {
+            auto const& field = std::get<I>(fields);
+            using field_type  = std::decay_t<decltype(field)>;
+            if constexpr (is_trivially_serializable_v<field_type>)
+            {
+                auto const* bytes = static_cast<char const*>(static_cast<void const*>(&field));
+                if (run_size && run_begin + run_size == bytes)
+                    run_size += sizeof(field_type);
+                else
+                {
+                    flush();
+                    run_begin = bytes;
+                    run_size  = sizeof(field_type);
+                }
+            }
+            else
+            {
+                flush();
+                encode_item(encoded_msg, type<field_type>{}, field);
+            }
+        }(),
+        ...);
+    flush();
+}
+}  // namespace detail
+
+// Aggregates are encoded field by field, unless there is a more specific overload.
+template <detail::reflectable T, typename U>
+void encode_item(packet& encoded_msg, type<T>, U&& param)
+{
+    auto fields = detail::tie_fields(std::as_const(param));
+    detail::encode_fields(encoded_msg, fields, std::make_index_sequence<std::tuple_size_v<decltype(fields)>>{});
+}
+
 namespace detail
 {
 namespace impl
@@ -82,7 +258,7 @@ template <typename T, typename U>
 requires is_trivially_serializable_v<T> && std::is_same_v<T, std::decay_t<U>>
 int internal_encode_item(packet& encoded_msg, type<T>, U&& param)
 {
-    encoded_msg.add_data({static_cast<char const*>(&param), sizeof(U)});
+    encoded_msg.add_data(std::span<char const>(static_cast<char const*>(static_cast<void const*>(&param)), sizeof(T)));
     return 0;
 }
 
@@ -91,14 +267,14 @@ requires(is_trivially_serializable_v<T> && (!std::is_same_v<T, std::decay_t<U>>)
                                                                                                            U&&     param)
 {
     T temp = param;
-    encoded_msg.add_data({static_cast<char const*>(&temp), sizeof(U)});
+    encoded_msg.add_data(std::span<char const>(static_cast<char const*>(static_cast<void const*>(&temp)), sizeof(T)));
     return 0;
 }
 
 template <typename U, typename T>
 requires(!is_trivially_serializable_v<T>) int internal_encode_item(packet& encoded_msg, type<T>, U&& param)
 {
-    tiny_ipc::encode_item(encoded_msg, type<T>{}, std::forward<U>(param));
+    encode_item(encoded_msg, type<T>{}, std::forward<U>(param));
     return 0;
 }
 template <typename... ListItems, typename... Ts>
@@ -0,0 +1,298 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_HANDSHAKE_H_INCLUDED
+#define TINY_IPC_DETAIL_HANDSHAKE_H_INCLUDED
+
+#include <sys/socket.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+#include <tiny_ipc/fd.hpp>
+#include <tiny_ipc/proto_def.hpp>
+#include <tiny_ipc/detail/protocol.hpp>
+#include <tiny_ipc/detail/reflection.hpp>
+
+namespace tiny_ipc::detail
+{
+namespace impl
+{
+constexpr uint64_t fnv64_init  = 0xcbf29ce484222325ull;
+constexpr uint64_t fnv64_prime = 0x100000001b3ull;
+
+constexpr uint64_t mix(uint64_t fingerprint, uint64_t value) noexcept
+{
+    for (int i = 0; i != 8; ++i) fingerprint = (fingerprint ^ ((value >> (i * 8)) & 0xFF)) * fnv64_prime;
+    return fingerprint;
+}
+
+// Nesting deeper than this is not looked into, which ends the recursion of self referencing aggregates.
+constexpr std::size_t max_shape_depth = 8;
+
+// Hash of how values of T are encoded, built from the codecs rather than from type names, so that it
+// does not depend on the compiler. Types with a codec of their own only count as such.
+template <typename T, std::size_t Depth>
+struct shape_of;
+
+template <typename T, std::size_t Depth>
+constexpr uint64_t shape_value()
+{
+    if constexpr (Depth == max_shape_depth)
+        return fnv64_init;
+    else
+        return shape_of<std::remove_cvref_t<T>, Depth + 1>::value;
+}
+
+template <typename T, std::size_t Depth>
+struct shape_of
+{
+    static constexpr uint64_t value = []
+    {
+        if constexpr (std::is_enum_v<T>)
+            return shape_value<std::underlying_type_t<T>, Depth>();
+        else if constexpr (std::is_same_v<T, bool>)
+            return mix(fnv64_init, 'b');
+        else if constexpr (std::is_integral_v<T>)
+            return mix(mix(fnv64_init, std::is_signed_v<T> ? 'i' : 'u'), sizeof(T));
+        else if constexpr (std::is_floating_point_v<T>)
+            return mix(mix(fnv64_init, 'f'), sizeof(T));
+        else if constexpr (reflectable<T>)
+            return mix(mix(fnv64_init, 'r'), shape_value<decltype(tie_fields(std::declval<T&>())), Depth>());
+        else if constexpr (is_trivially_serializable_v<T>)
+            return mix(mix(fnv64_init, 't'), sizeof(T));
+        else
+            return mix(fnv64_init, 'x');
+    }();
+};
+template <std::size_t Depth>
+struct shape_of<std::string, Depth>
+{
+    static constexpr uint64_t value = mix(fnv64_init, 's');
+};
+template <std::size_t Depth>
+struct shape_of<std::string_view, Depth> : shape_of<std::string, Depth>
+{
+};
+template <std::size_t Depth>
+struct shape_of<char const*, Depth> : shape_of<std::string, Depth>
+{
+};
+template <std::size_t Depth>
+struct shape_of<tiny_ipc::fd, Depth>
+{
+    static constexpr uint64_t value = mix(fnv64_init, 'd');
+};
+template <std::size_t Depth>
+struct shape_of<::ucred, Depth>
+{
+    static constexpr uint64_t value = mix(fnv64_init, 'c');
+};
+template <typename T, typename A, std::size_t Depth>
+struct shape_of<std::vector<T, A>, Depth>
+{
+    static constexpr uint64_t value = mix(mix(fnv64_init, 'v'), shape_value<T, Depth>());
+};
+template <typename T, std::size_t N, std::size_t Depth>
+struct shape_of<std::array<T, N>, Depth>
+{
+    static constexpr uint64_t value = mix(mix(mix(fnv64_init, 'a'), N), shape_value<T, Depth>());
+};
+template <typename T, std::size_t Depth>
+struct shape_of<std::optional<T>, Depth>
+{
+    static constexpr uint64_t value = mix(mix(fnv64_init, 'o'), shape_value<T, Depth>());
+};
+template <typename... Ts, std::size_t Depth>
+struct shape_of<std::variant<Ts...>, Depth>
+{
+    static constexpr uint64_t value = []
+    {
+        uint64_t shape = mix(mix(fnv64_init, 'V'), sizeof...(Ts));
+        ((shape = mix(shape, shape_value<Ts, Depth>())), ...);
+        return shape;
+    }();
+};
+template <typename... Ts, std::size_t Depth>
+struct shape_of<std::tuple<Ts...>, Depth>
+{
+    static constexpr uint64_t value = []
+    {
+        uint64_t shape = mix(mix(fnv64_init, 'T'), sizeof...(Ts));
+        ((shape = mix(shape, shape_value<Ts, Depth>())), ...);
+        return shape;
+    }();
+};
+template <typename A, typename B, std::size_t Depth>
+struct shape_of<std::pair<A, B>, Depth> : shape_of<std::tuple<A, B>, Depth>
+{
+};
+template <typename K, typename V, typename... Rest, std::size_t Depth>
+struct shape_of<std::map<K, V, Rest...>, Depth>
+{
+    static constexpr uint64_t value = mix(mix(mix(fnv64_init, 'm'), shape_value<K, Depth>()), shape_value<V, Depth>());
+};
+template <typename K, typename V, typename... Rest, std::size_t Depth>
+struct shape_of<std::unordered_map<K, V, Rest...>, Depth> : shape_of<std::map<K, V>, Depth>
+{
+};
+
+// Traits that change what goes over the wire, the others only affect how messages are scheduled.
+template <typename Trait>
+constexpr uint64_t wire_trait = 0;
+template <uint16_t Window>
+constexpr uint64_t wire_trait<streaming<Window>> = 's';
+template <std::size_t FullEvery>
+constexpr uint64_t wire_trait<delta_encoded<FullEvery>> = 'd';
+
+// Kind tells methods from signals.
+template <uint64_t Kind, typename N, typename Signature, typename... Traits>
+struct element_fingerprint;
+template <uint64_t Kind, typename N, typename R, typename... Ps, typename... Traits>
+struct element_fingerprint<Kind, N, R(Ps...), Traits...>
+{
+    static constexpr uint64_t value = []
+    {
+        uint64_t fingerprint = mix(mix(mix(fnv64_init, Kind), N::hash), (std::is_void_v<R> ? 0 : 0x100) | sizeof...(Ps));
+        if constexpr (!std::is_void_v<R>) fingerprint = mix(fingerprint, shape_value<R, 0>());
+        ((fingerprint = mix(fingerprint, shape_value<Ps, 0>())), ...);
+        ((fingerprint = wire_trait<Traits> ? mix(fingerprint, wire_trait<Traits>) : fingerprint), ...);
+        return fingerprint;
+    }();
+};
+
+template <typename T>
+struct fingerprint_of;
+template <typename N, typename S, typename... Traits>
+struct fingerprint_of<tiny_ipc::impl::method<N, S, Traits...>> : element_fingerprint<1, N, S, Traits...>
+{
+};
+template <typename N, typename S, typename... Traits>
+struct fingerprint_of<tiny_ipc::impl::signal<N, S, Traits...>> : element_fingerprint<2, N, S, Traits...>
+{
+};
+template <typename N, typename V, typename... Es>
+struct fingerprint_of<tiny_ipc::interface<N, V, Es...>>
+{
+    static constexpr uint64_t value = []
+    {
+        uint64_t fingerprint = mix(fnv64_init, tiny_ipc::interface<N, V, Es...>::hash);
+        ((fingerprint = mix(fingerprint, fingerprint_of<Es>::value)), ...);
+        return fingerprint;
+    }();
+};
+template <typename... Is>
+struct fingerprint_of<tiny_ipc::protocol<Is...>>
+{
+    static constexpr uint64_t value = []
+    {
+        uint64_t fingerprint = mix(fnv64_init, sizeof...(Is));
+        ((fingerprint = mix(fingerprint, fingerprint_of<Is>::value)), ...);
+        return fingerprint;
+    }();
+};
+
+template <typename P>
+struct interfaces_of;
+template <typename... Is>
+struct interfaces_of<tiny_ipc::protocol<Is...>>
+{
+    static std::vector<uint32_t> get() { return {control_interface, Is::hash...}; }
+};
+}  // namespace impl
+
+// Covers the names and versions of all interfaces and the names, kinds and signatures of their methods and signals,
+// including the traits that change the encoding.
+template <c::protocol P>
+constexpr uint64_t fingerprint = impl::fingerprint_of<P>::value;
+
+/**
+ * Frame header used once both peers agreed on the protocol in the handshake, in place of msg_header:
+ *
+ *     uint8_t  interface index, 0 for the control interface and 1.. for the interfaces of the protocol
+ *     uint8_t  flags, has_control and has_protocol
+ *     uint16_t id, cookie and payload size
+ *     uint16_t control size, only present with has_control
+ *
+ * Messages of interfaces outside the protocol are sent as escape byte followed by the whole msg_header.
+ */
+struct compact_format
+{
+    static constexpr uint8_t     escape       = 0xFF;
+    static constexpr uint8_t     has_control  = 1;
+    static constexpr uint8_t     has_protocol = 2;  // the message belongs to the protocol, otherwise a reply or control message
+    static constexpr std::size_t min_size     = 8;
+    static constexpr std::size_t max_size     = 1 + sizeof(msg_header);
+    static constexpr uint32_t    unknown      = std::numeric_limits<uint32_t>::max();
+
+    std::vector<uint32_t> interfaces;  // hash of the interface by index
+    uint32_t              protocol{0};
+
+    template <c::protocol P>
+    static compact_format of()
+    {
+        return {impl::interfaces_of<P>::get(), P::hash};
+    }
+
+    // Writes the header to out, which has room for max_size bytes, and returns the size written.
+    std::size_t encode(msg_header const& header, char* out) const noexcept
+    {
+        auto const index = static_cast<std::size_t>(std::find(interfaces.begin(), interfaces.end(), header.id.interface) - interfaces.begin());
+        if (index >= std::min<std::size_t>(interfaces.size(), escape) || (header.protocol != 0 && header.protocol != protocol))
+        {
+            out[0] = static_cast<char>(escape);
+            std::memcpy(out + 1, &header, sizeof(header));
+            return max_size;
+        }
+        uint8_t const flags = (header.control ? has_control : 0) | (header.protocol ? has_protocol : 0);
+        out[0]              = static_cast<char>(index);
+        out[1]              = static_cast<char>(flags);
+        std::memcpy(out + 2, &header.id.id, sizeof(uint16_t));
+        std::memcpy(out + 4, &header.id.cookie, sizeof(uint16_t));
+        std::memcpy(out + 6, &header.payload, sizeof(uint16_t));
+        if (!header.control) return min_size;
+        std::memcpy(out + 8, &header.control, sizeof(uint16_t));
+        return min_size + sizeof(uint16_t);
+    }
+
+    // Reads a header from the size bytes at in, returns the size it took or 0 when more bytes are needed.
+    std::size_t decode(char const* in, std::size_t size, msg_header& header) const noexcept
+    {
+        if (size == 0) return 0;
+        if (static_cast<uint8_t>(in[0]) == escape)
+        {
+            if (size < max_size) return 0;
+            std::memcpy(&header, in + 1, sizeof(header));
+            return max_size;
+        }
+        if (size < min_size) return 0;
+        auto const        index    = static_cast<uint8_t>(in[0]);
+        auto const        flags    = static_cast<uint8_t>(in[1]);
+        std::size_t const required = (flags & has_control) ? min_size + sizeof(uint16_t) : min_size;
+        if (size < required) return 0;
+
+        header              = msg_header{};
+        header.id.interface = index < interfaces.size() ? interfaces[index] : unknown;
+        header.protocol     = (flags & has_protocol) ? protocol : 0;
+        std::memcpy(&header.id.id, in + 2, sizeof(uint16_t));
+        std::memcpy(&header.id.cookie, in + 4, sizeof(uint16_t));
+        std::memcpy(&header.payload, in + 6, sizeof(uint16_t));
+        if (flags & has_control) std::memcpy(&header.control, in + 8, sizeof(uint16_t));
+        return required;
+    }
+};
+}  // namespace tiny_ipc::detail
+
+#endif
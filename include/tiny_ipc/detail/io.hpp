@@ -0,0 +1,61 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_IO_H_INCLUDED
+#define TINY_IPC_DETAIL_IO_H_INCLUDED
+
+#include <cerrno>
+#include <boost/system/error_code.hpp>
+
+#if defined(TINY_IPC_USE_EPOLL)
+#include <tiny_ipc/epoll.hpp>
+#else
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#endif
+
+namespace tiny_ipc
+{
+// Sockets and timers of client and server_session, built with TINY_IPC_USE_EPOLL they run on epoll::reactor instead of Boost.Asio.
+#if defined(TINY_IPC_USE_EPOLL)
+using socket_type   = epoll::socket;
+using executor_type = epoll::executor;
+using timer_type    = epoll::timer;
+#else
+using socket_type   = boost::asio::local::stream_protocol::socket;
+using executor_type = boost::asio::any_io_executor;
+using timer_type    = boost::asio::steady_timer;
+#endif
+
+namespace detail
+{
+#if defined(TINY_IPC_USE_EPOLL)
+constexpr auto wait_read  = epoll::wait_read;
+constexpr auto wait_write = epoll::wait_write;
+constexpr auto wait_error = epoll::wait_error;
+using epoll::post;
+#else
+constexpr auto wait_read  = boost::asio::socket_base::wait_read;
+constexpr auto wait_write = boost::asio::socket_base::wait_write;
+constexpr auto wait_error = boost::asio::socket_base::wait_error;
+using boost::asio::post;
+#endif
+
+// equal to boost::asio::error::no_buffer_space
+inline boost::system::error_code no_buffer_space() noexcept { return {ENOBUFS, boost::system::system_category()}; }
+// equal to boost::asio::error::operation_aborted
+inline boost::system::error_code operation_aborted() noexcept { return {ECANCELED, boost::system::system_category()}; }
+// equal to boost::system::errc::protocol_error
+inline boost::system::error_code protocol_error() noexcept { return {EPROTO, boost::system::system_category()}; }
+// equal to boost::asio::error::message_size
+inline boost::system::error_code message_size() noexcept { return {EMSGSIZE, boost::system::system_category()}; }
+// equal to boost::asio::error::timed_out
+inline boost::system::error_code timed_out() noexcept { return {ETIMEDOUT, boost::system::system_category()}; }
+}  // namespace detail
+}  // namespace tiny_ipc
+
+#endif
@@ -9,49 +9,376 @@
 #define _GNU_SOURCE 1
 #endif
 
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
-#include <boost/asio/local/stream_protocol.hpp>
+#include <fcntl.h>
+#include <cerrno>
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <memory>
+#include <tiny_ipc/buffer_pool.hpp>
+#include <tiny_ipc/capture.hpp>
+#include <tiny_ipc/fd.hpp>
+#include <tiny_ipc/proto_def.hpp>
+#include <tiny_ipc/detail/handshake.hpp>
+#include <tiny_ipc/detail/io.hpp>
 #include <tiny_ipc/detail/packet.hpp>
 #include <tiny_ipc/detail/message_parser.hpp>
 
 namespace tiny_ipc::detail
 {
+// A message that could not be written because the socket buffer was full.
+struct pending_frame
+{
+    std::vector<char> data;
+    std::vector<char> control;
+    std::vector<fd>   fds;  // duplicates of the descriptors referenced by control, owned until written
+    uint64_t          conflation_key{0};
+    bool              enables_compact{false};  // frames written after this one use the compact header
+
+    void assign(msghdr const* hdr)
+    {
+        enables_compact = false;
+        data.clear();
+        for (std::size_t i = 0; i != hdr->msg_iovlen; ++i)
+        {
+            auto const* base = static_cast<char const*>(hdr->msg_iov[i].iov_base);
+            data.insert(data.end(), base, base + hdr->msg_iov[i].iov_len);
+        }
+        auto const* ctrl = static_cast<char const*>(hdr->msg_control);
+        control.assign(ctrl, ctrl + hdr->msg_controllen);
+        fds.clear();
+        if (control.empty()) return;
+
+        // the sender may close its descriptors once send returns, so keep duplicates until the frame is written
+        msghdr copy{};
+        copy.msg_control    = control.data();
+        copy.msg_controllen = control.size();
+        for (cmsghdr* control_header = CMSG_FIRSTHDR(&copy); control_header; control_header = CMSG_NXTHDR(&copy, control_header))
+        {
+            if (control_header->cmsg_type != SCM_RIGHTS) continue;
+            auto* data_begin = reinterpret_cast<char*>(CMSG_DATA(control_header));
+            for (std::size_t i = 0; i != (control_header->cmsg_len - CMSG_LEN(0)) / sizeof(int); ++i)
+            {
+                int file_desc;
+                std::memcpy(&file_desc, data_begin + i * sizeof(int), sizeof(int));
+                file_desc = ::fcntl(file_desc, F_DUPFD_CLOEXEC, 0);
+                std::memcpy(data_begin + i * sizeof(int), &file_desc, sizeof(int));
+                fds.emplace_back(file_desc);
+            }
+        }
+    }
+};
+
 struct message_comm
 {
-    boost::asio::local::stream_protocol::socket& socket;
-    msg_header                                   receive_header;
-    std::vector<char>                            receive_payload;
-    std::vector<char>                            receive_ctrl;
-    message_comm(boost::asio::local::stream_protocol::socket& s) : socket(s)
+    // upper bound of the SCM_SECURITY label the kernel may attach to received messages
+    static constexpr std::size_t max_security_label = 256;
+    static constexpr std::size_t lane_count         = 3;
+
+    socket_type&                                      socket;
+    msg_header                                        receive_header;
+    std::vector<char>                                 receive_payload;
+    std::vector<char>                                 receive_ctrl;
+    std::vector<char>                                 spare_payload;  // the inline buffer while a frame borrowed a larger one
+    std::shared_ptr<buffer_pool>                      lender;         // of the buffer in receive_payload
+    receive_policy                                    receive;
+    boost::system::error_code                         receive_error;  // why the connection stopped receiving
+    iovec                                             receive_vec{};
+    msghdr                                            receive_message{};
+    std::size_t                                       received{0};  // bytes of the current frame in receive_payload
+    std::array<std::deque<pending_frame>, lane_count> send_queues;  // indexed by lane
+    std::vector<char>                                 unfinished;   // tail of a partially written frame
+    std::shared_ptr<capture_log>                      capture;
+    uint32_t                                          capture_connection{0};
+    bool                                              write_pending{false};
+    compact_format                                    compact;  // agreed on in the handshake
+    bool                                              compact_send{false};
+    bool                                              compact_receive{false};
+    std::size_t                                       receive_header_size{sizeof(msg_header)};  // on the wire
+    std::array<char, compact_format::max_size>        wire_header;
+    std::vector<iovec>                                wire_vecs;
+    msghdr                                            wire_message{};
+    message_comm(socket_type& s) : socket(s)
     {
         int enable = 1;
         setsockopt(socket.native_handle(), AF_UNIX, SO_PASSCRED, &enable, sizeof(enable));
         setsockopt(socket.native_handle(), AF_UNIX, SO_PASSSEC, &enable, sizeof(enable));
     }
 
+    // Records all frames sent and received from now on in log, pass nullptr to stop recording.
+    inline void capture_to(std::shared_ptr<capture_log> log)
+    {
+        capture = std::move(log);
+        if (capture) capture_connection = capture->add_connection();
+    }
+
+    // Reads what arrived of the next frame and returns true once it is complete. A frame written
+    // partially by the sender, or larger than the socket buffer, arrives in several parts, receivers
+    // wait for the socket again until then.
+    inline bool frame_available() noexcept
+    {
+        int const handle = socket.native_handle();
+        if (received == 0)
+        {
+            if (!peek_header(handle)) return false;
+            if (receive_header.payload > receive.max_payload)
+            {
+                // the frame cannot be skipped without reading it, so the connection ends instead
+                stop_receiving(message_size());
+                return false;
+            }
+            prepare_payload(sizeof(msg_header) + receive_header.payload);
+
+            // Descriptors and credentials come with the first part of the frame. SO_PASSCRED and SO_PASSSEC
+            // make the kernel prepend credentials and the security label of the sender, without room for
+            // those the descriptors passed are truncated away.
+            if (receive_header.control != 0)
+                receive_ctrl.resize(receive_header.control + CMSG_SPACE(sizeof(::ucred)) + CMSG_SPACE(max_security_label));
+            // a compact header is read into wire_header and replaced by the full msg_header
+            iovec parts[2]  = {{wire_header.data(), receive_header_size},
+                               {receive_payload.data() + sizeof(msg_header), receive_header.payload}};
+            receive_vec     = iovec{receive_payload.data(), receive_payload.size()};
+            receive_message = msghdr{nullptr, 0, compact_receive ? parts : &receive_vec, compact_receive ? 2u : 1u, nullptr, 0, 0};
+            if (receive_header.control != 0)
+            {
+                receive_message.msg_control    = receive_ctrl.data();
+                receive_message.msg_controllen = receive_ctrl.size();
+            }
+            auto const res             = ::recvmsg(handle, &receive_message, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+            receive_message.msg_iov    = &receive_vec;
+            receive_message.msg_iovlen = 1;
+            if (res < static_cast<ssize_t>(receive_header_size)) return false;
+            std::memcpy(receive_payload.data(), &receive_header, sizeof(msg_header));
+            received = res + sizeof(msg_header) - receive_header_size;
+        }
+        while (received < receive_payload.size())
+        {
+            auto const res = ::recv(handle, receive_payload.data() + received, receive_payload.size() - received, MSG_DONTWAIT);
+            if (res <= 0) return false;
+            received += res;
+        }
+        return true;
+    }
+
+    // Ends the connection after a frame that could not be handled, the error handlers report reason.
+    inline void stop_receiving(boost::system::error_code reason) noexcept
+    {
+        receive_error = reason;
+        boost::system::error_code ec;
+        socket.close(ec);
+    }
+
+    // Fills receive_header and receive_header_size once the header of the next frame arrived.
+    inline bool peek_header(int handle) noexcept
+    {
+        int available = 0;
+        if (::ioctl(handle, FIONREAD, &available) < 0) return false;
+        if (!compact_receive)
+        {
+            receive_header_size = sizeof(msg_header);
+            return available >= static_cast<int>(sizeof(msg_header)) &&
+                   ::recv(handle, &receive_header, sizeof(msg_header), MSG_PEEK | MSG_DONTWAIT) == sizeof(msg_header);
+        }
+        if (available < static_cast<int>(compact_format::min_size)) return false;
+        auto const peeked = ::recv(handle, wire_header.data(), std::min<std::size_t>(available, wire_header.size()), MSG_PEEK | MSG_DONTWAIT);
+        if (peeked <= 0) return false;
+        receive_header_size = compact.decode(wire_header.data(), peeked, receive_header);
+        return receive_header_size != 0;
+    }
+
+    // Hands out the frame completed by frame_available.
     inline detail::message_parser peek_and_receive() noexcept
     {
-        iovec  single_vec{&receive_header, sizeof(msg_header)};
-        msghdr received_message{nullptr, 0, &single_vec, 1, nullptr, 0, 0};
-        ::recvmsg(socket.native_handle(), &received_message, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+        received    = 0;
+        receive_vec = iovec{receive_payload.data(), receive_payload.size()};
+        if (capture) capture->record(capture_direction::received, capture_connection, &receive_message);
+        return detail::message_parser(&receive_message, {receive_payload.data(), receive_payload.size()});
+    }
+
+    // Gives back the buffer borrowed for a frame beyond the inline size, once the frame returned by
+    // peek_and_receive was handled.
+    inline void release_frame()
+    {
+        if (receive_payload.capacity() > receive.inline_size)
+        {
+            if (lender) lender->release(std::move(receive_payload));
+            receive_payload = std::move(spare_payload);
+            lender.reset();
+        }
+        if (receive_ctrl.capacity() > receive.inline_size) receive_ctrl = {};
+    }
+
+    // Bytes allocated for the buffers and queued frames of the connection.
+    inline std::size_t memory_usage() const noexcept
+    {
+        std::size_t bytes = receive_payload.capacity() + spare_payload.capacity() + receive_ctrl.capacity() + unfinished.capacity() +
+                            wire_vecs.capacity() * sizeof(iovec);
+        for (auto const& queue : send_queues)
+            for (auto const& frame : queue)
+                bytes += sizeof(frame) + frame.data.capacity() + frame.control.capacity() + frame.fds.capacity() * sizeof(fd);
+        return bytes;
+    }
+
+    // A message is written right away unless messages of its own or a more urgent lane are waiting,
+    // otherwise it is queued behind those of its lane and overtakes all queued messages of less urgent lanes.
+    inline void send(packet& message, lane priority = lane::normal) noexcept { send(message.commit_to_header(), priority); }
+    inline void send(msghdr const* hdr, lane priority = lane::normal) noexcept
+    {
+        if (!has_queued(priority) && write_frame(hdr)) return;
+        queue_of(priority).emplace_back().assign(hdr);
+        flush_when_writable();
+    }
+
+    // Sends the hello of the handshake, the compact header is used for all frames written after it.
+    inline void send_hello(packet& message) noexcept
+    {
+        auto const* hdr = message.commit_to_header();
+        if (!has_queued(lane::normal) && write_frame(hdr))
+        {
+            compact_send = true;
+            return;
+        }
+        auto& frame           = queue_of(lane::normal).emplace_back();
+        frame.assign(hdr);
+        frame.enables_compact = true;
+        flush_when_writable();
+    }
+
+    // Sends or queues a message of which only the most recent instance per conflation key is of interest:
+    // a queued message with the same key is replaced in place, keeping its position in the queue.
+    inline void send(packet& message, uint64_t conflation_key, lane priority = lane::normal) noexcept
+    {
+        send(message.commit_to_header(), conflation_key, priority);
+    }
+    inline void send(msghdr const* hdr, uint64_t conflation_key, lane priority = lane::normal) noexcept
+    {
+        if (!has_queued(priority) && write_frame(hdr)) return;
+        auto& queue  = queue_of(priority);
+        auto  queued = std::find_if(queue.begin(), queue.end(), [conflation_key](pending_frame const& f) { return f.conflation_key == conflation_key; });
+        if (queued == queue.end())
+        {
+            queued = queue.emplace(queue.end());
+            flush_when_writable();
+        }
+        queued->assign(hdr);
+        queued->conflation_key = conflation_key;
+    }
+
+    // true if messages of the given or a more urgent lane wait for the socket
+    inline bool has_queued(lane priority = lane::bulk) const noexcept
+    {
+        return !unfinished.empty() || std::any_of(send_queues.begin(), send_queues.begin() + static_cast<std::size_t>(priority) + 1,
+                                                  [](auto const& queue) { return !queue.empty(); });
+    }
+
+private:
+    inline std::deque<pending_frame>& queue_of(lane priority) noexcept { return send_queues[static_cast<std::size_t>(priority)]; }
+
+    // A frame beyond the inline size of the policy is received into a buffer of the pool or a buffer of its own.
+    inline void prepare_payload(std::size_t size)
+    {
+        if (size > receive.inline_size && size > receive_payload.capacity())
+        {
+            spare_payload   = std::move(receive_payload);
+            receive_payload = receive.pool ? receive.pool->acquire(size) : std::vector<char>(size);
+            lender          = receive.pool;
+        }
+        receive_payload.resize(size);
+    }
+
+    // Returns false when the frame could not be written and has to be queued. When the kernel accepts only
+    // a prefix of the frame, the remainder is kept in unfinished and written before any other frame.
+    inline bool write_frame(msghdr const* hdr) noexcept
+    {
+        if (!write_unfinished()) return false;
+
+        auto const* frame = compact_send ? to_compact(hdr) : hdr;
+        std::size_t total = 0;
+        for (std::size_t i = 0; i != frame->msg_iovlen; ++i) total += frame->msg_iov[i].iov_len;
+
+        auto written = ::sendmsg(socket.native_handle(), frame, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (written < 0) return errno != EAGAIN && errno != EWOULDBLOCK;  // on other errors the frame is lost anyway
+        if (capture) capture->record(capture_direction::sent, capture_connection, hdr);
+        if (static_cast<std::size_t>(written) == total) return true;
 
-        receive_payload.resize(sizeof(msg_header) + receive_header.payload);
-        single_vec = iovec{receive_payload.data(), receive_payload.size()};
+        std::size_t skip = written;
+        for (std::size_t i = 0; i != frame->msg_iovlen; ++i)
+        {
+            auto const* base = static_cast<char const*>(frame->msg_iov[i].iov_base);
+            auto const  len  = frame->msg_iov[i].iov_len;
+            if (skip < len) unfinished.insert(unfinished.end(), base + skip, base + len);
+            skip -= std::min(skip, len);
+        }
+        flush_when_writable();
+        return true;
+    }
 
-        if (receive_header.control != 0)
+    // Continues the frame of which only a prefix was written, returns true once nothing is left of it.
+    inline bool write_unfinished() noexcept
+    {
+        while (!unfinished.empty())
         {
-            receive_ctrl.resize(receive_header.control);
-            received_message.msg_control    = receive_ctrl.data();
-            received_message.msg_controllen = receive_ctrl.size();
+            auto res = ::send(socket.native_handle(), unfinished.data(), unfinished.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (res < 0 && errno == EINTR) continue;
+            if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;
+            if (res < 0)
+                unfinished.clear();
+            else
+                unfinished.erase(unfinished.begin(), unfinished.begin() + res);
         }
+        return true;
+    }
+
+    inline bool write_frame(pending_frame& frame) noexcept
+    {
+        iovec  single_vec{frame.data.data(), frame.data.size()};
+        msghdr hdr{nullptr, 0, &single_vec, 1, frame.control.empty() ? nullptr : frame.control.data(), frame.control.size(), 0};
+        if (!write_frame(&hdr)) return false;
+        if (frame.enables_compact) compact_send = true;
+        return true;
+    }
 
-        ::recvmsg(socket.native_handle(), &received_message, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
-        return detail::message_parser(&received_message, {receive_payload.data(), receive_payload.size()});
+    // Replaces the msg_header at the start of the frame with its compact form.
+    inline msghdr const* to_compact(msghdr const* hdr) noexcept
+    {
+        msg_header header;
+        std::memcpy(&header, hdr->msg_iov[0].iov_base, sizeof(header));
+        wire_vecs.resize(hdr->msg_iovlen + 1);
+        wire_vecs[0] = iovec{wire_header.data(), compact.encode(header, wire_header.data())};
+        wire_vecs[1] = iovec{static_cast<char*>(hdr->msg_iov[0].iov_base) + sizeof(header), hdr->msg_iov[0].iov_len - sizeof(header)};
+        std::copy(hdr->msg_iov + 1, hdr->msg_iov + hdr->msg_iovlen, wire_vecs.begin() + 2);
+        wire_message            = *hdr;
+        wire_message.msg_iov    = wire_vecs.data();
+        wire_message.msg_iovlen = wire_vecs.size();
+        return &wire_message;
+    }
+
+    inline void flush_when_writable()
+    {
+        if (write_pending) return;
+        write_pending = true;
+        socket.async_wait(wait_write,
+                          [this](boost::system::error_code ec)
+                          {
+                              write_pending = false;
+                              if (ec)
+                              {
+                                  unfinished.clear();
+                                  for (auto& queue : send_queues) queue.clear();
+                                  return;
+                              }
+                              if (!write_unfinished()) return flush_when_writable();
+                              for (auto& queue : send_queues)
+                              {
+                                  while (!queue.empty() && write_frame(queue.front())) queue.pop_front();
+                                  if (!queue.empty()) return flush_when_writable();
+                              }
+                          });
     }
-    inline void send(packet& message) noexcept { ::sendmsg(socket.native_handle(), message.commit_to_header(), MSG_NOSIGNAL); }
-    inline void send(msghdr const* hdr) noexcept { ::sendmsg(socket.native_handle(), hdr, MSG_NOSIGNAL); }
 };
 
 }  // namespace tiny_ipc::detail
@@ -21,12 +21,14 @@ struct message_parser
     msghdr*              hdr;
     std::span<char>      message_payload;
     std::vector<fd>      fds;
+    std::size_t          consumed_fds{0};
     std::optional<ucred> credentials;
+    bool                 failed{false};  // the payload did not hold what the signature expects
     message_parser(msghdr* header, std::span<char> const& payload) : hdr(header), message_payload(payload)
     {
         for (cmsghdr* control_header = CMSG_FIRSTHDR(hdr); control_header; control_header = CMSG_NXTHDR(hdr, control_header))
         {
-            auto data = std::span<char>(reinterpret_cast<char*>(CMSG_DATA(control_header)), control_header->cmsg_len);
+            auto data = std::span<char>(reinterpret_cast<char*>(CMSG_DATA(control_header)), control_header->cmsg_len - CMSG_LEN(0));
             if (control_header->cmsg_type == SCM_RIGHTS)
             {
                 fds.reserve(control_header->cmsg_len / sizeof(int));
@@ -47,22 +49,31 @@ struct message_parser
         }
     }
 
+    // A payload shorter than size fails the parser and yields an empty span.
     std::span<char> consume_message(std::size_t size)
     {
+        if (size > message_payload.size())
+        {
+            fail();
+            return {};
+        }
         auto ret        = message_payload.first(size);
         message_payload = message_payload.last(message_payload.size() - size);
         return ret;
     }
 
+    // Drops the rest of the payload, the frame is then reported as malformed instead of being handled.
+    void fail() noexcept
+    {
+        failed          = true;
+        message_payload = {};
+    }
+
     std::optional<::ucred> get_cred() { return credentials; }
     fd                     consume_fd()
     {
-        if (fds.size() > 0)
-        {
-            fd ret = fds.front();
-            fds.erase(fds.begin());
-            return ret;
-        }
+        if (consumed_fds < fds.size())
+            return fds[consumed_fds++];
         else
             return fd{};
     }
@@ -0,0 +1,72 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_MPSC_QUEUE_H_INCLUDED
+#define TINY_IPC_DETAIL_MPSC_QUEUE_H_INCLUDED
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace tiny_ipc::detail
+{
+/**
+ * Lock free queue with many producers and a single consumer. Producers push onto an intrusive stack
+ * with a compare and swap, the consumer takes the whole stack with one exchange and reverses it, so
+ * that it handles the values in the order they were pushed. Only the push onto an empty queue has to
+ * wake the consumer, later pushes are taken along by the same drain.
+ */
+template <typename T>
+class mpsc_queue
+{
+public:
+    mpsc_queue() = default;
+    mpsc_queue(mpsc_queue const&)            = delete;
+    mpsc_queue& operator=(mpsc_queue const&) = delete;
+    ~mpsc_queue()
+    {
+        drain([](T&&) {});
+    }
+
+    // May be called from any thread, returns true when the queue was empty.
+    bool push(T value)
+    {
+        auto* n        = new node{std::move(value), nullptr};
+        node* previous = head.load(std::memory_order_relaxed);
+        // once published the node belongs to the consumer, so only previous is looked at afterwards
+        do n->next = previous;
+        while (!head.compare_exchange_weak(previous, n, std::memory_order_release, std::memory_order_relaxed));
+        return previous == nullptr;
+    }
+
+    // Consumer side, passes the values pushed so far to f in push order and returns their number.
+    template <typename F>
+    std::size_t drain(F&& f)
+    {
+        node* reversed = head.exchange(nullptr, std::memory_order_acquire);
+        node* ordered  = nullptr;
+        while (reversed) ordered = std::exchange(reversed, std::exchange(reversed->next, ordered));
+        std::size_t count = 0;
+        while (ordered)
+        {
+            std::unique_ptr<node> taken(std::exchange(ordered, ordered->next));
+            f(std::move(taken->value));
+            ++count;
+        }
+        return count;
+    }
+
+    bool empty() const noexcept { return head.load(std::memory_order_acquire) == nullptr; }
+
+private:
+    struct node
+    {
+        T     value;
+        node* next;
+    };
+    std::atomic<node*> head{nullptr};
+};
+}  // namespace tiny_ipc::detail
+
+#endif
@@ -42,6 +42,7 @@ struct packet
     }
     packet(packet && other) = default;
     packet(packet const& other) = delete;
+    packet& operator=(packet&& other) = default;
     packet& operator=(packet const& other) = delete;
     void    add_fd(int fd) { fds.push_back(fd); }
     void    add_cred() noexcept { creds = true; }
@@ -74,8 +75,28 @@ struct packet
         }
     }
 
+    // Moves the data into the first buffer, so that offsets into the message address a single block.
+    void coalesce()
+    {
+        if (buffers.size() < 2) return;
+        std::vector<char> all;
+        all.reserve(size());
+        for (auto const& buf : buffers) all.insert(all.end(), buf.begin(), buf.end());
+        buffers.resize(1);
+        buffers[0] = std::move(all);
+    }
+
+    // bytes written so far including the message header
+    std::size_t size() const noexcept
+    {
+        std::size_t ret = 0;
+        for (auto const& buf : buffers) ret += buf.size();
+        return ret;
+    }
+
     msghdr* commit_to_header()
     {
+        iovecs.clear();
         iovecs.reserve(buffers.size());
         uint16_t final_size = 0;
         for (auto& buf : buffers)
@@ -0,0 +1,38 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_PRIORITY_H_INCLUDED
+#define TINY_IPC_DETAIL_PRIORITY_H_INCLUDED
+
+#include <type_traits>
+#include <tiny_ipc/proto_def.hpp>
+
+namespace tiny_ipc::detail
+{
+namespace impl
+{
+// the first priority trait decides
+template <typename... Traits>
+struct lane_of_traits : std::integral_constant<lane, lane::normal>
+{
+};
+template <lane L, typename... Traits>
+struct lane_of_traits<priority<L>, Traits...> : std::integral_constant<lane, L>
+{
+};
+template <typename T, typename... Traits>
+struct lane_of_traits<T, Traits...> : lane_of_traits<Traits...>
+{
+};
+}  // namespace impl
+
+template <typename Element>
+constexpr lane lane_of = lane::normal;
+template <typename N, typename S, typename... Traits>
+constexpr lane lane_of<tiny_ipc::impl::method<N, S, Traits...>> = impl::lane_of_traits<Traits...>::value;
+template <typename N, typename S, typename... Traits>
+constexpr lane lane_of<tiny_ipc::impl::signal<N, S, Traits...>> = impl::lane_of_traits<Traits...>::value;
+}  // namespace tiny_ipc::detail
+
+#endif
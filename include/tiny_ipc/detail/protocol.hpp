@@ -12,6 +12,7 @@
 #include <kvasir/mpl/sequence/front.hpp>
 #include <kvasir/mpl/types/bool.hpp>
 #include <boost/system/error_code.hpp>
+#include <tiny_tuple/map.h>
 #include <utility>
 
 namespace tiny_ipc
@@ -28,11 +29,33 @@ struct msg_header
     msg_id   id;
     uint16_t payload;
     uint16_t control;
+    uint32_t protocol{0};  // hash of the protocol the message belongs to, 0 for replies and control messages
     auto     operator<=>(msg_header const&) const = default;
 };
 namespace c = concepts;
 namespace detail
 {
+// Messages on the reserved interface 0 are not part of any user protocol,
+// they are generated and consumed by the library itself.
+constexpr uint32_t control_interface = 0;
+namespace control
+{
+// payload: uint16_t number of requests the server is willing to have in flight per client
+constexpr uint16_t credit_window = 1;
+// payload: a sequence of complete messages, each a msg_header followed by its payload
+constexpr uint16_t batch = 2;
+// payload: uint64_t fingerprint of the protocol of the sender, frames written after it use the compact_format
+// when the fingerprints of both peers match
+constexpr uint16_t hello = 3;
+// payload: uint32_t interface, uint16_t method id and optionally the encoded arguments of a call, the cached
+// replies of the method, or only those of calls with these arguments, are dropped
+constexpr uint16_t invalidate = 4;
+// payload: msg_id of a streaming call and uint16_t number of further items the client takes, 0 ends the stream
+constexpr uint16_t stream_credit = 5;
+// payload: msg_id of a call the server dropped without reply, the client completes it with operation_aborted
+constexpr uint16_t abandoned = 6;
+}  // namespace control
+
 template <c::element_name N>
 struct is_named_element
 {
@@ -40,12 +63,12 @@ struct is_named_element
     struct f_impl : kvasir::mpl::false_
     {
     };
-    template <typename Sig>
-    struct f_impl<tiny_ipc::impl::method<N, Sig>> : kvasir::mpl::true_
+    template <typename Sig, typename... Traits>
+    struct f_impl<tiny_ipc::impl::method<N, Sig, Traits...>> : kvasir::mpl::true_
     {
     };
-    template <typename Sig>
-    struct f_impl<tiny_ipc::impl::signal<N, Sig>> : kvasir::mpl::true_
+    template <typename Sig, typename... Traits>
+    struct f_impl<tiny_ipc::impl::signal<N, Sig, Traits...>> : kvasir::mpl::true_
     {
     };
     template <typename V, typename... Es>
@@ -71,11 +94,30 @@ struct is_interface_version
     using f = f_impl<Item>;
 };
 
+// Continuation of find_if, which passes on the found item followed by the rest of the list:
+// unpacks the found item into C, or calls C without parameters when there was no match.
+template <typename C>
+struct unpack_found
+{
+    template <typename... Ts>
+    struct f_impl
+    {
+        using type = kvasir::mpl::call<C>;
+    };
+    template <typename T, typename... Ts>
+    struct f_impl<T, Ts...>
+    {
+        using type = kvasir::mpl::call<kvasir::mpl::unpack<C>, T>;
+    };
+    template <typename... Ts>
+    using f = typename f_impl<Ts...>::type;
+};
+
 template <c::protocol P, c::interface_id I, c::element_name N>
 constexpr bool is_in_protocol =
     kvasir::mpl::call<
         kvasir::mpl::unpack<kvasir::mpl::find_if<is_interface_version<typename I::name, typename I::version>,
-                                                 kvasir::mpl::unpack<kvasir::mpl::find_if<is_named_element<N>, kvasir::mpl::size<>>>>>,
+                                                 unpack_found<kvasir::mpl::find_if<is_named_element<N>, kvasir::mpl::size<>>>>>,
         P>::value != 0;
 
 template <c::protocol P, c::interface_id I>
@@ -84,7 +126,7 @@ struct is_in_proto
     template <typename Name>
     using f = kvasir::mpl::call<
         kvasir::mpl::unpack<kvasir::mpl::find_if<is_interface_version<typename I::name, typename I::version>,
-                                                 kvasir::mpl::unpack<kvasir::mpl::find_if<is_named_element<Name>, kvasir::mpl::size<>>>>>,
+                                                 unpack_found<kvasir::mpl::find_if<is_named_element<Name>, kvasir::mpl::size<>>>>>,
         P>;
 };
 
@@ -94,7 +136,59 @@ constexpr bool are_in_protocol = kvasir::mpl::call<kvasir::mpl::unpack<kvasir::m
 template <c::interface I, c::element_name N>
 using get_signature = typename kvasir::mpl::call<kvasir::mpl::unpack<kvasir::mpl::find_if<is_named_element<N>, kvasir::mpl::front<>>>, I>;
 
+template <c::protocol P, typename Group>
+constexpr bool is_group_in_protocol = []()
+{
+    if constexpr (is_method_group<Group>)
+        return are_in_protocol<P, typename Group::id, typename Group::methods>;
+    else
+        return are_in_protocol<P, typename Group::id, typename Group::signals>;
+}();
+
+template <uint32_t... Hashes>
+constexpr bool are_distinct = []()
+{
+    uint32_t const hashes[] = {Hashes...};
+    for (std::size_t i = 0; i != sizeof...(Hashes); ++i)
+        for (std::size_t j = i + 1; j != sizeof...(Hashes); ++j)
+            if (hashes[i] == hashes[j]) return false;
+    return true;
+}();
 }  // namespace detail
+
+/**
+ * The method or signal handlers of a single protocol. Several of them can share one connection,
+ * see async_dispatch_protocols.
+ */
+template <c::protocol P, typename... Groups>
+struct protocol_handlers
+{
+    using protocol = P;
+    using dispatcher_type =
+        tiny_tuple::map<tiny_tuple::detail::item<typename Groups::id, decltype(Groups::dispatcher)>...>;
+    dispatcher_type dispatcher;
+    explicit protocol_handlers(Groups&&... gs)
+        : dispatcher(tiny_tuple::detail::item<typename Groups::id, decltype(Groups::dispatcher)>(std::move(gs.dispatcher))...)
+    {
+    }
+};
+
+template <c::protocol P, typename... Groups>
+requires(detail::is_group_in_protocol<P, std::decay_t<Groups>>&&... && true) auto handlers_of(Groups&&... gs)
+{
+    return protocol_handlers<P, std::decay_t<Groups>...>(std::decay_t<Groups>(std::forward<Groups>(gs))...);
+}
+
+template <typename T>
+constexpr bool is_protocol_handlers = false;
+template <typename P, typename... Groups>
+constexpr bool is_protocol_handlers<protocol_handlers<P, Groups...>> = true;
+
+namespace concepts
+{
+template <typename T>
+concept protocol_handlers = is_protocol_handlers<T>;
+}  // namespace concepts
 }  // namespace tiny_ipc
 
 #endif
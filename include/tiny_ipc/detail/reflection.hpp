@@ -0,0 +1,145 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_REFLECTION_H_INCLUDED
+#define TINY_IPC_DETAIL_REFLECTION_H_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <tiny_ipc/detail/serialization_utilities.hpp>
+
+namespace tiny_ipc::detail
+{
+namespace impl
+{
+struct any_field
+{
+    template <typename T>
+    operator T() const;
+};
+
+template <typename T, typename... Fields>
+constexpr std::size_t field_count()
+{
+    if constexpr (requires { T{std::declval<Fields>()..., std::declval<any_field>()}; })
+        return field_count<T, Fields..., any_field>();
+    else
+        return sizeof...(Fields);
+}
+
+template <typename T>
+struct is_std_array : std::false_type
+{
+};
+template <typename T, std::size_t N>
+struct is_std_array<std::array<T, N>> : std::true_type
+{
+};
+}  // namespace impl
+
+constexpr std::size_t max_reflected_fields = 16;
+
+// Aggregates without base classes that have no dedicated codec are encoded field by field.
+template <typename T>
+concept reflectable = std::is_class_v<T> && std::is_aggregate_v<T> && !is_trivially_serializable_v<T> && !impl::is_std_array<T>::value;
+
+template <reflectable T>
+constexpr std::size_t field_count = impl::field_count<T>();
+
+// Returns a tuple of references to the fields of value, found through structured bindings.
+template <typename T>
+requires reflectable<std::remove_const_t<T>>
+auto tie_fields(T& value)
+{
+    constexpr std::size_t count = field_count<std::remove_const_t<T>>;
+    static_assert(count <= max_reflected_fields, "too many fields, provide encode_item and decode_item overloads for this type");
+    if constexpr (count == 16)
+    {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15] = value;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15);
+    }
+    else if constexpr (count == 15)
+    {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14] = value;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14);
+    }
+    else if constexpr (count == 14)
+    {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13] = value;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13);
+    }
+    else if constexpr (count == 13)
+    {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12] = value;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12);
+    }
+    else if constexpr (count == 12)
+    {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11] = value;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11);
+    }
+    else if constexpr (count == 11)
+    {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10] = value;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10);
+    }
+    else if constexpr (count == 10)
+    {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9] = value;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9);
+    }
+    else if constexpr (count == 9)
+    {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8] = value;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8);
+    }
+    else if constexpr (count == 8)
+    {
+        auto& [f0, f1, f2, f3, f4, f5, f6, f7] = value;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6, f7);
+    }
+    else if constexpr (count == 7)
+    {
+        auto& [f0, f1, f2, f3, f4, f5, f6] = value;
+        return std::tie(f0, f1, f2, f3, f4, f5, f6);
+    }
+    else if constexpr (count == 6)
+    {
+        auto& [f0, f1, f2, f3, f4, f5] = value;
+        return std::tie(f0, f1, f2, f3, f4, f5);
+    }
+    else if constexpr (count == 5)
+    {
+        auto& [f0, f1, f2, f3, f4] = value;
+        return std::tie(f0, f1, f2, f3, f4);
+    }
+    else if constexpr (count == 4)
+    {
+        auto& [f0, f1, f2, f3] = value;
+        return std::tie(f0, f1, f2, f3);
+    }
+    else if constexpr (count == 3)
+    {
+        auto& [f0, f1, f2] = value;
+        return std::tie(f0, f1, f2);
+    }
+    else if constexpr (count == 2)
+    {
+        auto& [f0, f1] = value;
+        return std::tie(f0, f1);
+    }
+    else if constexpr (count == 1)
+    {
+        auto& [f0] = value;
+        return std::tie(f0);
+    }
+    else
+        return std::tuple<>();
+}
+}  // namespace tiny_ipc::detail
+
+#endif
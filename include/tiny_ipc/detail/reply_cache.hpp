@@ -0,0 +1,127 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_REPLY_CACHE_H_INCLUDED
+#define TINY_IPC_DETAIL_REPLY_CACHE_H_INCLUDED
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <tiny_ipc/proto_def.hpp>
+#include <tiny_ipc/detail/packet.hpp>
+
+namespace tiny_ipc::detail
+{
+namespace impl
+{
+template <typename T>
+struct ttl_of : std::integral_constant<std::size_t, 0>
+{
+};
+template <std::size_t TtlMilliseconds>
+struct ttl_of<cacheable<TtlMilliseconds>> : std::integral_constant<std::size_t, TtlMilliseconds>
+{
+};
+
+template <typename Element>
+struct cache_ttl_of : std::integral_constant<std::size_t, 0>
+{
+};
+template <typename N, typename S, typename... Traits>
+struct cache_ttl_of<tiny_ipc::impl::method<N, S, Traits...>> : std::integral_constant<std::size_t, std::max({std::size_t{0}, ttl_of<Traits>::value...})>
+{
+};
+}  // namespace impl
+
+template <typename Element>
+constexpr bool is_cacheable = impl::cache_ttl_of<Element>::value != 0;
+template <typename Element>
+constexpr std::chrono::milliseconds cache_ttl{impl::cache_ttl_of<Element>::value};
+
+/**
+ * Decoded replies of cacheable methods by call. The key of a call is the interface hash and method id
+ * followed by the encoded arguments, the payload of control::invalidate uses the same layout, so an
+ * invalidation drops the entries its payload is a prefix of. Expired entries are dropped when looked
+ * up, or when the cache is full.
+ */
+class reply_cache
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit reply_cache(std::size_t capacity = 1024) : capacity(capacity) {}
+
+    // Key of the encoded call, empty when the call carries file descriptors or credentials and cannot be cached.
+    static std::string key_of(packet const& call)
+    {
+        std::string key;
+        if (call.creds || !call.fds.empty()) return key;
+        msg_header header;
+        std::memcpy(&header, call.buffers[0].data(), sizeof(header));
+        key.reserve(sizeof(uint32_t) + sizeof(uint16_t) + call.size() - sizeof(msg_header));
+        key.append(reinterpret_cast<char const*>(&header.id.interface), sizeof(uint32_t));
+        key.append(reinterpret_cast<char const*>(&header.id.id), sizeof(uint16_t));
+        key.append(call.buffers[0].data() + sizeof(msg_header), call.buffers[0].size() - sizeof(msg_header));
+        for (std::size_t i = 1; i != call.buffers.size(); ++i) key.append(call.buffers[i].data(), call.buffers[i].size());
+        return key;
+    }
+
+    // R has to be the type the entry was stored with, which the method in the key decides.
+    template <typename R>
+    R const* find(std::string const& key, clock::time_point now = clock::now())
+    {
+        auto it = entries.find(key);
+        if (it == entries.end()) return nullptr;
+        if (it->second.expiry <= now)
+        {
+            entries.erase(it);
+            return nullptr;
+        }
+        return static_cast<R const*>(it->second.value.get());
+    }
+
+    template <typename R>
+    void insert(std::string key, clock::duration ttl, R value)
+    {
+        auto const now = clock::now();
+        if (entries.size() >= capacity && !entries.contains(key)) make_room(now);
+        entries.insert_or_assign(std::move(key), entry{std::make_shared<R const>(std::move(value)), now + ttl});
+    }
+
+    // Drops the entries whose key starts with prefix, all calls of a method or the calls with the given arguments.
+    void invalidate(std::string_view prefix)
+    {
+        auto it = entries.lower_bound(prefix);
+        while (it != entries.end() && std::string_view(it->first).starts_with(prefix)) it = entries.erase(it);
+    }
+
+    void        clear() noexcept { entries.clear(); }
+    std::size_t size() const noexcept { return entries.size(); }
+
+private:
+    struct entry
+    {
+        std::shared_ptr<void const> value;
+        clock::time_point           expiry;
+    };
+
+    std::map<std::string, entry, std::less<>> entries;
+    std::size_t                               capacity;
+
+    // drops the expired entries, or the one expiring first when none expired
+    void make_room(clock::time_point now)
+    {
+        std::erase_if(entries, [now](auto const& e) { return e.second.expiry <= now; });
+        if (entries.size() < capacity || entries.empty()) return;
+        entries.erase(std::min_element(entries.begin(), entries.end(), [](auto const& l, auto const& r) { return l.second.expiry < r.second.expiry; }));
+    }
+};
+}  // namespace tiny_ipc::detail
+
+#endif
@@ -10,11 +10,15 @@
 #endif
 #include <kvasir/mpl/types/list.hpp>
 #include <type_traits>
+#include <optional>
 #include <span>
 #include <string_view>
+#include <variant>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <tiny_ipc/fd.hpp>
+#include <tiny_ipc/file_slice.hpp>
+#include <tiny_ipc/shared_buffer.hpp>
 #include <tiny_ipc/proto_def.hpp>
 
 namespace tiny_ipc
@@ -50,10 +54,27 @@ template <>
 struct is_trivially_serializable<fd> : std::false_type
 {
 };
+template <>
+struct is_trivially_serializable<file_slice> : std::false_type
+{
+};
+template <typename T>
+struct is_trivially_serializable<shared_buffer<T>> : std::false_type
+{
+};
 template <typename T>
 struct is_trivially_serializable<std::span<T>> : std::false_type
 {
 };
+// optional and variant are encoded with a one byte tag instead of their in memory representation
+template <typename T>
+struct is_trivially_serializable<std::optional<T>> : std::false_type
+{
+};
+template <typename... Ts>
+struct is_trivially_serializable<std::variant<Ts...>> : std::false_type
+{
+};
 template <typename T>
 constexpr bool is_trivially_serializable_v = is_trivially_serializable<T>::type::value;
 
@@ -63,27 +84,27 @@ namespace impl
 {
 template <typename S>
 struct to_list;
-template <c::method_name M, typename R, typename... S>
-struct to_list<tiny_ipc::impl::method<M, R(S...)>>
+template <c::method_name M, typename R, typename... S, typename... Traits>
+struct to_list<tiny_ipc::impl::method<M, R(S...), Traits...>>
 {
     using type = kvasir::mpl::list<std::decay_t<S>...>;
 };
-template <c::signal_name S, typename R, typename... T>
-struct to_list<tiny_ipc::impl::signal<S, R(T...)>>
+template <c::signal_name S, typename R, typename... T, typename... Traits>
+struct to_list<tiny_ipc::impl::signal<S, R(T...), Traits...>>
 {
     using type = kvasir::mpl::list<std::decay_t<T>...>;
 };
 template <typename S>
 struct to_return_type;
-template <c::method_name M, typename R, typename... S>
-struct to_return_type<tiny_ipc::impl::method<M, R(S...)>>
+template <c::method_name M, typename R, typename... S, typename... Traits>
+struct to_return_type<tiny_ipc::impl::method<M, R(S...), Traits...>>
 {
     using type = kvasir::mpl::list<std::decay_t<R>>;
 };
 template <typename S>
 struct just_return_type;
-template <c::method_name M, typename R, typename... S>
-struct just_return_type<tiny_ipc::impl::method<M, R(S...)>>
+template <c::method_name M, typename R, typename... S, typename... Traits>
+struct just_return_type<tiny_ipc::impl::method<M, R(S...), Traits...>>
 {
     using type = std::decay_t<R>;
 };
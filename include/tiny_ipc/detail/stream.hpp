@@ -0,0 +1,70 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_STREAM_H_INCLUDED
+#define TINY_IPC_DETAIL_STREAM_H_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <tiny_ipc/proto_def.hpp>
+#include <tiny_ipc/detail/protocol.hpp>
+#include <tiny_ipc/detail/packet.hpp>
+#include <tiny_ipc/detail/encode.hpp>
+#include <tiny_ipc/detail/decode.hpp>
+
+namespace tiny_ipc::detail
+{
+namespace impl
+{
+template <typename T>
+struct window_of : std::integral_constant<uint16_t, 0>
+{
+};
+template <uint16_t Window>
+struct window_of<streaming<Window>> : std::integral_constant<uint16_t, Window>
+{
+};
+
+template <typename Element>
+struct stream_window_of : std::integral_constant<uint16_t, 0>
+{
+};
+template <typename N, typename S, typename... Traits>
+struct stream_window_of<tiny_ipc::impl::method<N, S, Traits...>> : std::integral_constant<uint16_t, std::max({uint16_t{0}, window_of<Traits>::value...})>
+{
+};
+}  // namespace impl
+
+template <typename Element>
+constexpr bool is_streaming = impl::stream_window_of<Element>::value != 0;
+template <typename Element>
+constexpr uint16_t stream_window = impl::stream_window_of<Element>::value;
+
+// Each frame of a stream is a reply to the call, its payload starts with one of these tags.
+constexpr uint8_t stream_item = 0;  // followed by the encoded item
+constexpr uint8_t stream_end  = 1;
+
+inline packet stream_credit_message(msg_id const& call, uint16_t count)
+{
+    packet new_msg(msg_header{{control_interface, control::stream_credit, 0}, sizeof(msg_id) + sizeof(count), 0});
+    encode_item(new_msg, type<uint32_t>{}, call.interface);
+    encode_item(new_msg, type<uint16_t>{}, call.id);
+    encode_item(new_msg, type<uint16_t>{}, call.cookie);
+    encode_item(new_msg, type<uint16_t>{}, count);
+    return new_msg;
+}
+
+inline std::pair<msg_id, uint16_t> decode_stream_credit(message_parser& msg)
+{
+    msg_id call;
+    call.interface = decode_item(msg, type<uint32_t>{});
+    call.id        = decode_item(msg, type<uint16_t>{});
+    call.cookie    = decode_item(msg, type<uint16_t>{});
+    return {call, decode_item(msg, type<uint16_t>{})};
+}
+}  // namespace tiny_ipc::detail
+
+#endif
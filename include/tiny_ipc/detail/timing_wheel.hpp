@@ -0,0 +1,182 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_DETAIL_TIMING_WHEEL_H_INCLUDED
+#define TINY_IPC_DETAIL_TIMING_WHEEL_H_INCLUDED
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace tiny_ipc::detail
+{
+/**
+ * Hashed timing wheel, used for the deadlines of requests. Deadlines are rounded up to whole ticks and
+ * kept in the list of slot tick % slot_count, a deadline more than one revolution ahead stays in its
+ * slot until its tick comes around. Insert and cancel are O(1) and do not allocate once enough nodes
+ * exist, expire only visits the slots of the ticks that passed.
+ */
+template <typename T>
+class timing_wheel
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t no_node = std::numeric_limits<uint32_t>::max();
+
+    // The generation tells apart entries stored in the same node, cancelling an expired entry does nothing.
+    struct handle
+    {
+        uint32_t index{no_node};
+        uint32_t generation{0};
+    };
+
+    explicit timing_wheel(clock::duration resolution = std::chrono::milliseconds(1), std::size_t slot_count = 1024)
+        : resolution(resolution), origin(clock::now()), slots(slot_count, no_node)
+    {
+    }
+
+    bool        empty() const noexcept { return count == 0; }
+    std::size_t size() const noexcept { return count; }
+
+    handle insert(clock::time_point deadline, T value)
+    {
+        uint32_t index = free_nodes;
+        if (index == no_node)
+        {
+            index = nodes.size();
+            nodes.emplace_back();
+        }
+        else
+            free_nodes = nodes[index].next;
+
+        auto& n = nodes[index];
+        n.value = std::move(value);
+        n.tick  = std::max(tick_after(deadline), current + 1);
+        n.used  = true;
+        link(index);
+        ++count;
+        return {index, n.generation};
+    }
+
+    bool contains(handle h) const noexcept
+    {
+        return h.index < nodes.size() && nodes[h.index].used && nodes[h.index].generation == h.generation;
+    }
+
+    bool cancel(handle h) noexcept
+    {
+        if (!contains(h)) return false;
+        unlink(h.index);
+        release(h.index);
+        return true;
+    }
+
+    void clear() noexcept
+    {
+        for (uint32_t i = 0; i != nodes.size(); ++i)
+            if (nodes[i].used) release(i);
+        std::fill(slots.begin(), slots.end(), no_node);
+    }
+
+    // Removes the entries whose deadline passed and invokes on_expired with the value of each of them.
+    template <typename F>
+    void expire(clock::time_point now, F&& on_expired)
+    {
+        uint64_t const now_tick = tick_before(now);
+        if (now_tick <= current) return;
+
+        std::vector<T> expired;
+        expired.swap(due);
+        // one revolution visits every slot
+        for (uint64_t tick = current + 1, last = std::min(now_tick, current + slots.size()); tick <= last; ++tick)
+        {
+            for (uint32_t index = slots[tick % slots.size()]; index != no_node;)
+            {
+                auto& n    = nodes[index];
+                auto  next = n.next;
+                if (n.tick <= now_tick)
+                {
+                    expired.push_back(std::move(n.value));
+                    unlink(index);
+                    release(index);
+                }
+                index = next;
+            }
+        }
+        current = now_tick;
+
+        for (auto& value : expired) on_expired(std::move(value));
+        expired.clear();
+        due.swap(expired);
+    }
+
+    // Start of the first tick with entries in its slot, the entries may belong to a later revolution though.
+    clock::time_point next_expiry() const noexcept
+    {
+        if (empty()) return clock::time_point::max();
+        for (uint64_t tick = current + 1;; ++tick)
+            if (slots[tick % slots.size()] != no_node) return origin + resolution * static_cast<clock::rep>(tick);
+    }
+
+private:
+    struct node
+    {
+        T        value{};
+        uint64_t tick{0};
+        uint32_t prev{no_node};
+        uint32_t next{no_node};
+        uint32_t generation{0};
+        bool     used{false};
+    };
+
+    clock::duration       resolution;
+    clock::time_point     origin;
+    std::vector<uint32_t> slots;  // first node of each slot
+    std::vector<node>     nodes;
+    std::vector<T>        due;  // kept to reuse its memory
+    uint32_t              free_nodes{no_node};
+    std::size_t           count{0};
+    uint64_t              current{0};  // the last tick that was expired
+
+    uint64_t tick_before(clock::time_point t) const noexcept { return t <= origin ? 0 : (t - origin) / resolution; }
+    uint64_t tick_after(clock::time_point t) const noexcept { return t <= origin ? 0 : (t - origin + resolution - clock::duration(1)) / resolution; }
+
+    void link(uint32_t index) noexcept
+    {
+        auto& n    = nodes[index];
+        auto& head = slots[n.tick % slots.size()];
+        n.prev     = no_node;
+        n.next     = head;
+        if (head != no_node) nodes[head].prev = index;
+        head = index;
+    }
+
+    void unlink(uint32_t index) noexcept
+    {
+        auto& n = nodes[index];
+        if (n.prev != no_node)
+            nodes[n.prev].next = n.next;
+        else
+            slots[n.tick % slots.size()] = n.next;
+        if (n.next != no_node) nodes[n.next].prev = n.prev;
+    }
+
+    void release(uint32_t index) noexcept
+    {
+        auto& n = nodes[index];
+        n.used  = false;
+        n.value = T{};
+        ++n.generation;
+        n.next     = free_nodes;
+        free_nodes = index;
+        --count;
+    }
+};
+}  // namespace tiny_ipc::detail
+
+#endif
@@ -0,0 +1,625 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_EPOLL_H_INCLUDED
+#define TINY_IPC_EPOLL_H_INCLUDED
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <boost/system/error_code.hpp>
+
+/**
+ * A minimal single threaded event loop on edge triggered epoll, for builds that do not want to pull
+ * in Boost.Asio. It covers what client and server_session need from Asio: waiting for readiness of
+ * unix stream sockets, posting work from other threads (eventfd) and timers (timerfd). Define
+ * TINY_IPC_USE_EPOLL to run client and server_session on it.
+ *
+ * Like Asio, handlers are never invoked from within the call that starts an operation and cancelled
+ * waits complete with operation_aborted. Each descriptor supports one outstanding wait per wait_type.
+ */
+namespace tiny_ipc::epoll
+{
+enum wait_type
+{
+    wait_read,
+    wait_write,
+    wait_error
+};
+
+inline boost::system::error_code operation_aborted() noexcept { return {ECANCELED, boost::system::system_category()}; }
+inline boost::system::error_code bad_descriptor() noexcept { return {EBADF, boost::system::system_category()}; }
+inline boost::system::error_code last_error() noexcept { return {errno, boost::system::system_category()}; }
+
+class reactor;
+
+namespace detail
+{
+// A posted function, unlike std::function it may be move only.
+struct task
+{
+    virtual ~task()   = default;
+    virtual void run() = 0;
+};
+template <typename F>
+struct task_of final : task
+{
+    F    f;
+    void run() override { f(); }
+    explicit task_of(F&& fun) : f(std::move(fun)) {}
+};
+
+/**
+ * Storage for one pending completion handler. The memory is kept when the handler completed, so
+ * waiting again with a handler of the same type does not allocate.
+ */
+class wait_handler
+{
+public:
+    wait_handler() = default;
+    wait_handler(wait_handler const&)            = delete;
+    wait_handler& operator=(wait_handler const&) = delete;
+    ~wait_handler()
+    {
+        reset();
+        ::operator delete(storage, alignment);
+    }
+
+    template <typename F>
+    void assign(F&& f)
+    {
+        using handler_type = std::decay_t<F>;
+        static_assert(alignof(handler_type) <= alignof(std::max_align_t));
+        reset();
+        if (capacity < sizeof(handler_type))
+        {
+            ::operator delete(storage, alignment);
+            storage  = ::operator new(sizeof(handler_type), alignment);
+            capacity = sizeof(handler_type);
+        }
+        new (storage) handler_type(std::forward<F>(f));
+        complete_fn = [](void* p, boost::system::error_code ec)
+        {
+            auto&        stored = *static_cast<handler_type*>(p);
+            handler_type handler(std::move(stored));
+            stored.~handler_type();
+            handler(ec);
+        };
+        destroy_fn = [](void* p) { static_cast<handler_type*>(p)->~handler_type(); };
+        detach_fn  = [](void* p, boost::system::error_code ec) -> std::unique_ptr<task>
+        {
+            auto& stored = *static_cast<handler_type*>(p);
+            auto  bound  = [handler = std::move(stored), ec]() mutable { handler(ec); };
+            stored.~handler_type();
+            return std::make_unique<task_of<decltype(bound)>>(std::move(bound));
+        };
+    }
+
+    bool armed() const noexcept { return complete_fn != nullptr; }
+
+    // The handler is moved out before it runs, so it may wait again or destroy the owner of this slot.
+    void complete(boost::system::error_code ec) { std::exchange(complete_fn, nullptr)(storage, ec); }
+
+    // Moves the handler into a task that invokes it with ec, the slot is free for the next wait right away.
+    std::unique_ptr<task> detach(boost::system::error_code ec)
+    {
+        complete_fn = nullptr;
+        return detach_fn(storage, ec);
+    }
+
+    void reset() noexcept
+    {
+        if (complete_fn) destroy_fn(storage);
+        complete_fn = nullptr;
+    }
+
+private:
+    static constexpr std::align_val_t alignment{alignof(std::max_align_t)};
+
+    void*       storage{nullptr};
+    std::size_t capacity{0};
+    void (*complete_fn)(void*, boost::system::error_code){nullptr};
+    void (*destroy_fn)(void*){nullptr};
+    std::unique_ptr<task> (*detach_fn)(void*, boost::system::error_code){nullptr};
+};
+
+enum class descriptor_kind : uint8_t
+{
+    stream,
+    listener,
+    timer
+};
+
+// A file descriptor registered with the reactor, with one handler slot per wait_type.
+struct descriptor
+{
+    reactor*                                 owner;
+    int                                      fd{-1};
+    descriptor_kind                          kind;
+    bool                                     readable{false};  // an input edge was seen and not yet drained
+    bool                                     failed{false};
+    std::array<wait_handler, 3>              waits;
+    std::array<bool, 3>                      queued{};
+    std::array<boost::system::error_code, 3> results;
+
+    descriptor(reactor& r, descriptor_kind k) : owner(&r), kind(k) {}
+    descriptor(descriptor const&)            = delete;
+    descriptor& operator=(descriptor const&) = delete;
+    inline ~descriptor();
+
+    template <typename F>
+    void start_wait(wait_type w, F&& f);
+    inline void cancel_waits() noexcept;
+    inline void attach(int file_desc);
+    inline void detach() noexcept;
+};
+}  // namespace detail
+
+struct executor
+{
+    reactor* context;
+
+    friend bool operator==(executor const&, executor const&) = default;
+};
+
+class reactor
+{
+public:
+    reactor() : epoll_fd(::epoll_create1(EPOLL_CLOEXEC)), wake_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+    {
+        epoll_event ev{};
+        ev.events   = EPOLLIN;
+        ev.data.ptr = nullptr;  // marks the eventfd
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+    }
+    reactor(reactor const&)            = delete;
+    reactor& operator=(reactor const&) = delete;
+    ~reactor()
+    {
+        ::close(wake_fd);
+        ::close(epoll_fd);
+    }
+
+    executor get_executor() noexcept { return {this}; }
+
+    // Runs handlers until stopped or no waits and posted functions are left.
+    std::size_t run()
+    {
+        std::size_t count = 0;
+        while (do_one(-1)) ++count;
+        return count;
+    }
+    std::size_t run_one() { return do_one(-1); }
+    // Runs the handlers that are ready without blocking.
+    std::size_t poll()
+    {
+        std::size_t count = 0;
+        while (do_one(0)) ++count;
+        return count;
+    }
+    template <typename Rep, typename Period>
+    std::size_t run_for(std::chrono::duration<Rep, Period> const& duration)
+    {
+        auto const  end   = std::chrono::steady_clock::now() + duration;
+        std::size_t count = 0;
+        for (auto now = std::chrono::steady_clock::now(); now < end; now = std::chrono::steady_clock::now())
+        {
+            auto const timeout = std::chrono::ceil<std::chrono::milliseconds>(end - now).count();
+            if (!do_one(static_cast<int>(timeout))) break;
+            ++count;
+        }
+        return count;
+    }
+
+    // Makes run and run_one return as soon as possible, may be called from any thread.
+    void stop() noexcept
+    {
+        stopped_flag.store(true);
+        wake();
+    }
+    bool stopped() const noexcept { return stopped_flag.load(); }
+    void restart() noexcept { stopped_flag.store(false); }
+
+    // Queues f to run on the thread of the reactor, may be called from any thread.
+    template <typename F>
+    void post(F&& f)
+    {
+        ++outstanding;
+        bool was_empty;
+        {
+            std::lock_guard lock(posted_guard);
+            was_empty = posted.empty();
+            posted.push_back(std::make_unique<detail::task_of<std::decay_t<F>>>(std::decay_t<F>(std::forward<F>(f))));
+        }
+        if (was_empty) wake();
+    }
+
+private:
+    friend struct detail::descriptor;
+
+    struct ready_entry
+    {
+        detail::descriptor* target;
+        wait_type           which;
+    };
+
+    int                                        epoll_fd;
+    int                                        wake_fd;
+    std::atomic<bool>                          stopped_flag{false};
+    std::atomic<std::size_t>                   outstanding{0};  // armed waits and posted functions
+    std::vector<ready_entry>                   ready;           // completions to invoke, consumed from ready_head
+    std::size_t                                ready_head{0};
+    std::size_t                                polled_until{0};  // ready entries queued before the last look at epoll
+    std::mutex                                 posted_guard;
+    std::vector<std::unique_ptr<detail::task>> posted;
+    std::vector<std::unique_ptr<detail::task>> running;  // posted functions taken over by the reactor thread
+    std::size_t                                running_head{0};
+
+    void wake() noexcept
+    {
+        uint64_t one = 1;
+        [[maybe_unused]] auto res = ::write(wake_fd, &one, sizeof(one));
+    }
+
+    void schedule(detail::descriptor& d, wait_type w, boost::system::error_code ec)
+    {
+        if (!d.waits[w].armed() || d.queued[w]) return;
+        d.queued[w]  = true;
+        d.results[w] = ec;
+        ready.push_back({&d, w});
+    }
+
+    void forget(detail::descriptor& d) noexcept
+    {
+        for (std::size_t i = ready_head; i != ready.size(); ++i)
+            if (ready[i].target == &d) ready[i].target = nullptr;
+    }
+
+    // Completes the wait with operation_aborted independently of the descriptor, which may wait again at once.
+    void abort(detail::descriptor& d, wait_type w)
+    {
+        if (!d.waits[w].armed()) return;
+        if (d.queued[w])
+        {
+            d.queued[w] = false;
+            for (std::size_t i = ready_head; i != ready.size(); ++i)
+                if (ready[i].target == &d && ready[i].which == w) ready[i].target = nullptr;
+        }
+        running.push_back(d.waits[w].detach(operation_aborted()));
+    }
+
+    void dispatch_events(epoll_event const* events, int count)
+    {
+        for (int i = 0; i != count; ++i)
+        {
+            auto const flags = events[i].events;
+            if (events[i].data.ptr == nullptr)
+            {
+                uint64_t value;
+                [[maybe_unused]] auto res = ::read(wake_fd, &value, sizeof(value));
+                std::lock_guard lock(posted_guard);
+                for (auto& f : posted) running.push_back(std::move(f));
+                posted.clear();
+                continue;
+            }
+            auto& d = *static_cast<detail::descriptor*>(events[i].data.ptr);
+            if (d.kind == detail::descriptor_kind::timer)
+            {
+                // an expiry without a waiter completes the next wait
+                uint64_t expirations;
+                if (::read(d.fd, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+                if (d.waits[wait_read].armed())
+                    schedule(d, wait_read, {});
+                else
+                    d.readable = true;
+                continue;
+            }
+            if (flags & (EPOLLIN | EPOLLERR | EPOLLHUP)) d.readable = true;
+            if (flags & (EPOLLERR | EPOLLHUP))
+            {
+                d.failed = true;
+                schedule(d, wait_error, {});
+            }
+            if (flags & (EPOLLIN | EPOLLERR | EPOLLHUP)) schedule(d, wait_read, {});
+            if (flags & (EPOLLOUT | EPOLLERR | EPOLLHUP)) schedule(d, wait_write, {});
+        }
+    }
+
+    bool wait_for_events(int timeout_ms)
+    {
+        std::array<epoll_event, 64> events;
+        int                         count;
+        do
+            count = ::epoll_wait(epoll_fd, events.data(), events.size(), timeout_ms);
+        while (count < 0 && errno == EINTR);
+        if (count > 0) dispatch_events(events.data(), count);
+        return count > 0;
+    }
+
+    std::size_t do_one(int timeout_ms)
+    {
+        while (!stopped())
+        {
+            bool const idle = ready_head == ready.size() && running_head == running.size();
+            // Completions queued by handlers go behind the events that arrived meanwhile, so a handler that
+            // keeps waiting on a descriptor with input left cannot starve the other descriptors.
+            if (idle || (ready_head != ready.size() && ready_head == polled_until))
+            {
+                if (idle && outstanding == 0) return 0;
+                if (!wait_for_events(idle ? timeout_ms : 0) && idle) return 0;
+                polled_until = ready.size();
+                continue;
+            }
+            if (ready_head != ready.size())
+            {
+                auto const entry = ready[ready_head++];
+                if (ready_head == ready.size()) ready_head = polled_until = 0, ready.clear();
+                if (!entry.target) continue;
+                entry.target->queued[entry.which] = false;
+                if (!entry.target->waits[entry.which].armed()) continue;
+                --outstanding;
+                entry.target->waits[entry.which].complete(entry.target->results[entry.which]);
+                return 1;
+            }
+            auto task = std::move(running[running_head++]);
+            if (running_head == running.size()) running_head = 0, running.clear();
+            --outstanding;
+            task->run();
+            return 1;
+        }
+        return 0;
+    }
+};
+
+template <typename F>
+void post(executor ex, F&& f)
+{
+    ex.context->post(std::forward<F>(f));
+}
+
+namespace detail
+{
+template <typename F>
+void descriptor::start_wait(wait_type w, F&& f)
+{
+    waits[w].assign(std::forward<F>(f));
+    ++owner->outstanding;
+    if (fd < 0) return owner->schedule(*this, w, bad_descriptor());
+    if (failed) return owner->schedule(*this, w, {});
+    if (w != wait_read || !readable) return;
+    if (kind == descriptor_kind::timer)
+    {
+        readable = false;
+        return owner->schedule(*this, w, {});
+    }
+
+    // an edge only comes with new input, so find out whether input of the last one is still there
+    int available = 0;
+    if (kind == descriptor_kind::listener || (::ioctl(fd, FIONREAD, &available) == 0 && available > 0))
+        owner->schedule(*this, w, {});
+    else
+        readable = false;
+}
+
+void descriptor::cancel_waits() noexcept
+{
+    for (int w = wait_read; w <= wait_error; ++w) owner->abort(*this, static_cast<wait_type>(w));
+}
+
+void descriptor::attach(int file_desc)
+{
+    fd       = file_desc;
+    readable = false;
+    failed   = false;
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    epoll_event ev{};
+    ev.events   = kind == descriptor_kind::timer ? EPOLLIN : EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = this;
+    ::epoll_ctl(owner->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void descriptor::detach() noexcept
+{
+    if (fd < 0) return;
+    cancel_waits();
+    ::epoll_ctl(owner->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    fd = -1;
+}
+
+descriptor::~descriptor()
+{
+    detach();
+    owner->forget(*this);
+    for (auto& w : waits)
+    {
+        if (w.armed()) --owner->outstanding;
+        w.reset();
+    }
+}
+}  // namespace detail
+
+// Unix stream socket with the subset of the interface of boost::asio::local::stream_protocol::socket used by tiny_ipc.
+class socket
+{
+public:
+    explicit socket(reactor& r) : d(r, detail::descriptor_kind::stream) {}
+    // takes ownership of a connected socket
+    socket(reactor& r, int file_desc) : socket(r) { assign(file_desc); }
+
+    void assign(int file_desc)
+    {
+        close();
+        d.attach(file_desc);
+    }
+    void connect(char const* path, boost::system::error_code& ec)
+    {
+        close();
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+        int const file_desc = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (file_desc < 0 || ::connect(file_desc, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            ec = last_error();
+            if (file_desc >= 0) ::close(file_desc);
+            return;
+        }
+        ec = {};
+        d.attach(file_desc);
+    }
+
+    int      native_handle() const noexcept { return d.fd; }
+    bool     is_open() const noexcept { return d.fd >= 0; }
+    executor get_executor() const noexcept { return {d.owner}; }
+
+    // Invokes f with an error_code once the socket is ready for w, or the wait was cancelled.
+    template <typename F>
+    void async_wait(wait_type w, F&& f)
+    {
+        d.start_wait(w, std::forward<F>(f));
+    }
+
+    void cancel() noexcept { d.cancel_waits(); }
+    void cancel(boost::system::error_code& ec) noexcept
+    {
+        cancel();
+        ec = {};
+    }
+    void close() noexcept { d.detach(); }
+    void close(boost::system::error_code& ec) noexcept
+    {
+        close();
+        ec = {};
+    }
+
+private:
+    detail::descriptor d;
+};
+
+inline bool connect_pair(socket& first, socket& second)
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) return false;
+    first.assign(fds[0]);
+    second.assign(fds[1]);
+    return true;
+}
+
+// Listening unix socket, accepted connections are handed out as file descriptors.
+class acceptor
+{
+public:
+    acceptor(reactor& r, char const* path, boost::system::error_code& ec) : d(r, detail::descriptor_kind::listener)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+        int const file_desc = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (file_desc < 0 || ::bind(file_desc, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(file_desc, SOMAXCONN) != 0)
+        {
+            ec = last_error();
+            if (file_desc >= 0) ::close(file_desc);
+            return;
+        }
+        ec = {};
+        d.attach(file_desc);
+    }
+
+    bool is_open() const noexcept { return d.fd >= 0; }
+
+    // Invokes f with an error_code and the descriptor of the next connection.
+    template <typename F>
+    void async_accept(F&& f)
+    {
+        d.start_wait(wait_read,
+                     [this, f = std::forward<F>(f)](boost::system::error_code ec) mutable
+                     {
+                         if (ec) return f(ec, -1);
+                         int const file_desc = ::accept4(d.fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+                         if (file_desc >= 0) return f(ec, file_desc);
+                         if (errno != EAGAIN && errno != EWOULDBLOCK) return f(last_error(), -1);
+                         // the backlog is drained, wait for the next edge
+                         d.readable = false;
+                         async_accept(std::move(f));
+                     });
+    }
+
+    void close() noexcept { d.detach(); }
+
+private:
+    detail::descriptor d;
+};
+
+// One shot timer on a timerfd of CLOCK_MONOTONIC, which is the clock of std::chrono::steady_clock.
+class timer
+{
+public:
+    explicit timer(reactor& r) : d(r, detail::descriptor_kind::timer)
+    {
+        d.attach(::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK));
+    }
+    explicit timer(executor ex) : timer(*ex.context) {}
+
+    // Setting a new expiry cancels a pending wait.
+    void expires_at(std::chrono::steady_clock::time_point t) noexcept
+    {
+        cancel();
+        // a zero expiry would disarm the timer
+        auto const ns = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count());
+        itimerspec spec{};
+        spec.it_value.tv_sec  = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+        ::timerfd_settime(d.fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+    template <typename Rep, typename Period>
+    void expires_after(std::chrono::duration<Rep, Period> const& duration) noexcept
+    {
+        expires_at(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration));
+    }
+
+    template <typename F>
+    void async_wait(F&& f)
+    {
+        d.start_wait(wait_read, std::forward<F>(f));
+    }
+
+    void cancel() noexcept
+    {
+        itimerspec disarm{};
+        ::timerfd_settime(d.fd, 0, &disarm, nullptr);
+        d.readable = false;
+        d.cancel_waits();
+    }
+
+private:
+    detail::descriptor d;
+};
+}  // namespace tiny_ipc::epoll
+
+#endif
@@ -0,0 +1,86 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_FILE_SLICE_H_INCLUDED
+#define TINY_IPC_FILE_SLICE_H_INCLUDED
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <tiny_ipc/fd.hpp>
+
+namespace tiny_ipc
+{
+namespace detail
+{
+// A read only mapping of a file region, unmapped with its last owner.
+struct file_mapping
+{
+    void*       base{MAP_FAILED};
+    std::size_t size{0};
+    std::size_t skip{0};  // from the page aligned start of the mapping to the region
+
+    file_mapping() = default;
+    file_mapping(file_mapping const&)            = delete;
+    file_mapping& operator=(file_mapping const&) = delete;
+    ~file_mapping()
+    {
+        if (base != MAP_FAILED) ::munmap(base, size);
+    }
+};
+}  // namespace detail
+
+/**
+ * A region of a file, passed as file descriptor with offset and length, so that the contents never
+ * pass through the socket. The receiver maps the region read only when it first accesses data(),
+ * copies of the slice made afterwards share the mapping. The sender must not shrink the file while
+ * the receiver may still access it, a memfd with F_SEAL_SHRINK rules that out.
+ */
+struct file_slice
+{
+    tiny_ipc::fd file;
+    uint64_t     offset{0};
+    uint64_t     length{0};
+
+    file_slice() = default;
+    file_slice(tiny_ipc::fd file, uint64_t offset, uint64_t length) : file(std::move(file)), offset(offset), length(length) {}
+
+    // Empty when the region is empty, extends past the end of the file or cannot be mapped.
+    std::span<char const> data() const
+    {
+        if (!mapping) mapping = map();
+        if (mapping->base == MAP_FAILED) return {};
+        return {static_cast<char const*>(mapping->base) + mapping->skip, static_cast<std::size_t>(length)};
+    }
+    std::string_view view() const
+    {
+        auto const bytes = data();
+        return {bytes.data(), bytes.size()};
+    }
+
+private:
+    mutable std::shared_ptr<detail::file_mapping const> mapping;
+
+    std::shared_ptr<detail::file_mapping const> map() const
+    {
+        auto        result = std::make_shared<detail::file_mapping>();
+        struct stat info;
+        if (length == 0 || static_cast<int>(file) < 0 || ::fstat(file, &info) != 0 || offset > static_cast<uint64_t>(info.st_size) ||
+            length > static_cast<uint64_t>(info.st_size) - offset)
+            return result;
+        auto const page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+        result->skip    = offset % page;
+        result->size    = result->skip + length;
+        result->base    = ::mmap(nullptr, result->size, PROT_READ, MAP_SHARED, file, static_cast<off_t>(offset - result->skip));
+        return result;
+    }
+};
+}  // namespace tiny_ipc
+
+#endif
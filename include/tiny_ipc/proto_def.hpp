@@ -6,6 +6,7 @@
 
 #include <type_traits>
 #include <cstddef>
+#include <cstdint>
 #include <algorithm>
 #include <tiny_tuple/map.h>
 #include <kvasir/mpl/types/list.hpp>
@@ -274,23 +275,81 @@ concept signature = is_signature<T>;
 namespace c = concepts;
 namespace impl
 {
-template <c::method_name Name, c::signature Sig>
+template <c::method_name Name, c::signature Sig, typename... Traits>
 struct method
 {
     static constexpr uint32_t hash = Name::hash;
     using name                     = Name;
     using signature                = Sig;
+    using traits                   = kvasir::mpl::list<Traits...>;
 };
-template <c::signal_name Name, c::signature Sig>
+template <c::signal_name Name, c::signature Sig, typename... Traits>
 struct signal
 {
     static constexpr uint32_t hash = Name::hash;
     using name                     = Name;
     using signature                = Sig;
+    using traits                   = kvasir::mpl::list<Traits...>;
 };
 
 }  // namespace impl
 
+// Traits may follow the signature of a method or signal declaration:
+// ti::signal<void(position), ti::conflate>("position"_s)
+
+// Only the newest not yet written instance of the signal is kept per session.
+struct conflate
+{
+};
+// Like conflate, but one instance is kept for each distinct value of the parameter at Index.
+template <std::size_t Index>
+struct conflate_by
+{
+};
+
+// The signal is sent as difference to the value previously sent to the same session, with a full
+// snapshot every FullEvery messages. The receiver rebuilds the complete value before decoding it.
+template <std::size_t FullEvery = 64>
+struct delta_encoded
+{
+};
+
+// Messages waiting for the socket are written lane by lane, within a lane they keep their order.
+enum class lane : uint8_t
+{
+    urgent,
+    normal,
+    bulk
+};
+// Assigns the messages of a method or signal, and the replies of a method, to a lane. Without it they use lane::normal.
+template <lane L>
+struct priority
+{
+};
+
+// The client answers repeated calls of the method with the same arguments from a cache of replies, for
+// TtlMilliseconds after the reply arrived or until the server invalidates them with invalidate_cached.
+template <std::size_t TtlMilliseconds = 1000>
+struct cacheable
+{
+    static_assert(TtlMilliseconds > 0, "cached replies need a time to live");
+};
+
+// The method replies with a sequence of items of its return type instead of a single value. The server
+// sends at most Window items ahead of those the client consumed, see stream_writer and stream_completion.
+template <uint16_t Window = 16>
+struct streaming
+{
+    static_assert(Window > 0, "a stream needs room for at least one item");
+};
+
+template <typename Element, typename Trait>
+constexpr bool has_trait = false;
+template <typename N, typename S, typename... Traits, typename Trait>
+constexpr bool has_trait<impl::method<N, S, Traits...>, Trait> = (std::is_same_v<Traits, Trait> || ...);
+template <typename N, typename S, typename... Traits, typename Trait>
+constexpr bool has_trait<impl::signal<N, S, Traits...>, Trait> = (std::is_same_v<Traits, Trait> || ...);
+
 template <typename T>
 constexpr bool is_method = impl::is_same_template<T, impl::method>::type::value;
 template <typename T>
@@ -304,13 +363,13 @@ template <typename T>
 concept signal = is_signal<T>;
 }  // namespace concepts
 
-template <c::signature Sig, c::method_name Name>
-constexpr impl::method<Name, Sig> method(Name &&) noexcept
+template <c::signature Sig, typename... Traits, c::method_name Name>
+constexpr impl::method<Name, Sig, Traits...> method(Name &&) noexcept
 {
     return {};
 }
-template <c::signature Sig, c::signal_name Name>
-constexpr impl::signal<Name, Sig> signal(Name &&) noexcept
+template <c::signature Sig, typename... Traits, c::signal_name Name>
+constexpr impl::signal<Name, Sig, Traits...> signal(Name &&) noexcept
 {
     return {};
 }
@@ -381,7 +440,8 @@ concept interface_id = is_interface_id<T>;
 template <c::interface... Args>
 struct protocol
 {
-    using interfaces = tiny_tuple::map<tiny_tuple::detail::item<typename Args::id, Args>...>;
+    using interfaces               = tiny_tuple::map<tiny_tuple::detail::item<typename Args::id, Args>...>;
+    static constexpr uint32_t hash = (prime32_init ^ ... ^ (Args::hash * prime32_const));
     constexpr protocol(Args &&...) noexcept {}
 };
 
@@ -5,27 +5,43 @@
 #ifndef TINY_IPC_SERVER_SESSION_H_INCLUDED
 #define TINY_IPC_SERVER_SESSION_H_INCLUDED
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <functional>
 #include <ranges>
+#include <tuple>
 #include <type_traits>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <vector>
 #include <ranges>
 #include <tiny_ipc/proto_def.hpp>
 #include <tiny_ipc/detail/protocol.hpp>
 #include <tiny_ipc/detail/encode.hpp>
 #include <tiny_ipc/detail/decode.hpp>
+#include <tiny_ipc/detail/batch.hpp>
+#include <tiny_ipc/detail/conflation.hpp>
+#include <tiny_ipc/detail/delta.hpp>
+#include <tiny_ipc/detail/handshake.hpp>
+#include <tiny_ipc/detail/io.hpp>
+#include <tiny_ipc/detail/priority.hpp>
 #include <tiny_ipc/detail/message_comm.hpp>
+#include <tiny_ipc/detail/reply_cache.hpp>
+#include <tiny_ipc/detail/stream.hpp>
 #include <tiny_ipc/detail/to_item.hpp>
 #include <tiny_ipc/detail/forward_item.hpp>
-#include <boost/asio/local/stream_protocol.hpp>
-#include <boost/asio/buffer.hpp>
-#include <boost/asio/basic_socket.hpp>
-#include <boost/asio/read.hpp>
 #include <tiny_tuple/map.h>
+#include <sys/socket.h>
 
 namespace tiny_ipc
 {
 struct server_session;
+namespace detail
+{
+struct stream_state;
+}
 
 namespace concepts
 {
@@ -39,67 +55,417 @@ concept session_error_handler = requires
 struct server_session
 {
     detail::message_comm communicator;
+    // expires with the session, deferred replies use it to detect that the client is gone
+    std::shared_ptr<server_session*> self{std::make_shared<server_session*>(this)};
+    // last values sent of delta encoded signals
+    std::vector<detail::delta_state> delta_states;
+    // open streams of streaming calls, owned by their stream_writer
+    std::vector<std::weak_ptr<detail::stream_state>> streams;
+
     template <c::session_error_handler H>
-    explicit server_session(boost::asio::local::stream_protocol::socket& s, H on_error) : communicator{s}
+    explicit server_session(socket_type& s, H on_error) : communicator{s}
     {
-        communicator.socket.async_wait(boost::asio::socket_base::wait_error,
+        communicator.socket.async_wait(detail::wait_error,
                                        [this, on_error](boost::system::error_code ec) mutable
                                        {
                                            boost::system::error_code e;
                                            communicator.socket.cancel(e);
                                            communicator.socket.close(e);
-                                           on_error(ec, *this);
+                                           on_error(communicator.receive_error ? communicator.receive_error : ec, *this);
                                        });
     }
+    ~server_session();
 
     void close()
     {
         communicator.socket.cancel();
         communicator.socket.close();
     }
+
+    // Bytes allocated by the session for its buffers, queued frames and delta encoding state.
+    std::size_t memory_usage() const noexcept
+    {
+        std::size_t bytes = sizeof(*this) + communicator.memory_usage() + delta_states.capacity() * sizeof(detail::delta_state) +
+                            streams.capacity() * sizeof(streams[0]);
+        for (auto const& state : delta_states) bytes += state.last.capacity();
+        return bytes;
+    }
+
+    // Tells the client how many requests awaiting a reply it may have in flight.
+    void advertise_credit_window(uint16_t window)
+    {
+        packet new_msg(msg_header{{detail::control_interface, detail::control::credit_window, 0}, sizeof(window), 0});
+        encode_item(new_msg, type<uint16_t>{}, window);
+        communicator.send(new_msg, lane::urgent);
+    }
 };
 
+namespace detail
+{
+// Shared by the copies of a deferred_reply. Only the first reply is sent, a cookie may be reused by the
+// client once its call completed. Dropping the last copy without reply tells the client the call was abandoned.
+struct deferred_state
+{
+    std::weak_ptr<server_session*> session;
+    executor_type                  executor;
+    msg_id                         id;
+    lane                           priority;
+    std::atomic<bool>              completed{false};
+
+    ~deferred_state()
+    {
+        if (completed.load(std::memory_order_acquire) || session.expired()) return;
+        packet abandoned(msg_header{{control_interface, control::abandoned, 0}, sizeof(msg_id), 0});
+        encode_item(abandoned, type<uint32_t>{}, id.interface);
+        encode_item(abandoned, type<uint16_t>{}, id.id);
+        encode_item(abandoned, type<uint16_t>{}, id.cookie);
+        complete(std::move(abandoned));
+    }
+
+    // Sends msg from the executor of the session, returns false when the call was completed before.
+    bool complete(packet msg)
+    {
+        if (completed.exchange(true, std::memory_order_acq_rel)) return false;
+        detail::post(executor,
+                     [session = session, msg = std::move(msg), priority = priority]() mutable
+                     {
+                         if (auto s = session.lock()) (*s)->communicator.send(msg, priority);
+                     });
+        return true;
+    }
+};
+}  // namespace detail
+
+/**
+ * Handed to method handlers that take it as additional last parameter. The handler may return
+ * without producing a value and complete the call later, from any thread, by invoking the token
+ * with the reply value. The reply is encoded on the calling thread and sent from the executor of
+ * the session. Copies share the call, only the first invocation sends a reply and returns true.
+ * When the last copy is dropped without reply the client completes the call with operation_aborted.
+ * Replies for sessions that are gone by then are dropped.
+ */
+template <typename R>
+struct deferred_reply
+{
+    std::shared_ptr<detail::deferred_state> state;
+
+    template <typename T>
+    bool operator()(T&& value)
+    {
+        if (state->completed.load(std::memory_order_acquire)) return false;
+        R const reply_value = std::forward<T>(value);
+        packet  new_msg(msg_header{state->id, 128, 0});
+        encode_item(new_msg, type<R>{}, reply_value);
+        return state->complete(std::move(new_msg));
+    }
+};
+
+namespace detail
+{
+// Shared by the copies of a stream_writer, the session finds it by the call to apply the credit of the client.
+struct stream_state
+{
+    std::weak_ptr<server_session*> session;
+    msg_id                         id;
+    lane                           priority;
+    std::size_t                    credit;  // items the client takes before returning credit
+    bool                           done{false};
+    std::function<void()>          on_ready;
+
+    ~stream_state() { finish(); }
+
+    // Sends the end of the stream, unless it ended before.
+    void finish()
+    {
+        if (std::exchange(done, true)) return;
+        on_ready = nullptr;
+        if (auto s = session.lock())
+        {
+            packet end(msg_header{id, sizeof(uint8_t), 0});
+            encode_item(end, type<uint8_t>{}, stream_end);
+            (*s)->communicator.send(end, priority);
+        }
+    }
+};
+}  // namespace detail
+
+inline server_session::~server_session()
+{
+    // the on_ready callback of a stream usually holds a writer of the stream
+    for (auto const& stream : streams)
+        if (auto state = stream.lock())
+        {
+            state->done     = true;
+            state->on_ready = nullptr;
+        }
+}
+
+/**
+ * Handed to the handlers of streaming methods as additional last parameter. Each write sends one item
+ * as a reply frame of the call, close sends the end of the stream, as does the destruction of the last
+ * copy of the writer. The client takes at most the window of the method beyond the items it consumed,
+ * write refuses further items and returns false. The callback passed to on_ready is invoked once the
+ * client returned credit or cancelled the stream. Writers are used on the executor of the session.
+ */
+template <typename T>
+struct stream_writer
+{
+    std::shared_ptr<detail::stream_state> state;
+
+    bool        open() const noexcept { return !state->done && !state->session.expired(); }
+    std::size_t credit() const noexcept { return open() ? state->credit : 0; }
+
+    template <typename U>
+    bool write(U&& item) const
+    {
+        auto s = state->session.lock();
+        if (!s || state->done || state->credit == 0) return false;
+        T const item_value = std::forward<U>(item);
+        packet  new_msg(msg_header{state->id, 128, 0});
+        encode_item(new_msg, type<uint8_t>{}, detail::stream_item);
+        encode_item(new_msg, type<T>{}, item_value);
+        (*s)->communicator.send(new_msg, state->priority);
+        --state->credit;
+        return true;
+    }
+
+    template <typename F>
+    void on_ready(F&& f) const
+    {
+        state->on_ready = std::forward<F>(f);
+    }
+
+    void close() const { state->finish(); }
+};
+
+// Streams the items of a generator, a callable returning std::optional with std::nullopt after the last
+// item. The generator is only invoked while the client has credit, so the consumer paces it.
+template <typename T, typename G>
+void pump_stream(stream_writer<T> out, G next)
+{
+    while (out.credit())
+    {
+        auto item = next();
+        if (!item)
+        {
+            out.close();
+            return;
+        }
+        out.write(std::move(*item));
+    }
+    if (out.open()) out.on_ready([out, next = std::move(next)]() mutable { pump_stream(std::move(out), std::move(next)); });
+}
+
+namespace detail
+{
+template <typename Element, typename Handler, typename List = typename impl::to_list<Element>::type>
+constexpr bool takes_stream_writer = false;
+template <typename Element, typename Handler, typename... Params>
+constexpr bool takes_stream_writer<Element, Handler, kvasir::mpl::list<Params...>> =
+    std::is_invocable_v<Handler&, Params..., stream_writer<just_return_type_t<Element>>>;
+
+template <typename Element, typename Handler, typename List = typename impl::to_list<Element>::type>
+constexpr bool takes_deferred_reply = false;
+template <typename Element, typename Handler, typename... Params>
+constexpr bool takes_deferred_reply<Element, Handler, kvasir::mpl::list<Params...>> =
+    std::is_invocable_v<Handler&, Params..., deferred_reply<just_return_type_t<Element>>>;
+
+// Invokes the method handler for a single message. Replies are sent immediately, or appended to
+// batched_replies when the call was part of a batch frame.
+template <c::protocol P, typename Dispatcher>
+void dispatch_method(server_session& s, msg_header const& header, message_parser& msg, Dispatcher& interface_dispatcher,
+                     packet* batched_replies)
+{
+    detail::forward_item<P>(  //
+        header.id.interface, header.id.id, interface_dispatcher,
+        [&s, &header, &msg, batched_replies](auto& handler, auto const& signature)
+        {
+            using element    = std::decay_t<decltype(signature)>;
+            using reply_type = detail::just_return_type_t<element>;
+            if constexpr (is_streaming<element>)
+            {
+                static_assert(!std::is_same_v<void, reply_type>, "a streaming method needs an item type as return type");
+                static_assert(takes_stream_writer<element, std::decay_t<decltype(handler)>>,
+                              "the handler of a streaming method takes a stream_writer as additional last parameter");
+                auto state = std::make_shared<stream_state>(s.self, header.id, lane_of<element>, std::size_t{stream_window<element>});
+                std::erase_if(s.streams, [](auto const& stream) { return stream.expired(); });
+                s.streams.push_back(state);
+                detail::decode<element>(msg, [&handler, &state](auto&&... params)
+                                        { handler(std::forward<decltype(params)>(params)..., stream_writer<reply_type>{std::move(state)}); });
+            }
+            else if constexpr (std::is_same_v<void, reply_type>) { detail::decode<element>(msg, handler); }
+            else if constexpr (takes_deferred_reply<element, std::decay_t<decltype(handler)>>)
+            {
+                deferred_reply<reply_type> reply{
+                    std::make_shared<deferred_state>(s.self, s.communicator.socket.get_executor(), header.id, lane_of<element>)};
+                detail::decode<element>(msg, [&handler, &reply](auto&&... params)
+                                        { handler(std::forward<decltype(params)>(params)..., std::move(reply)); });
+            }
+            else
+            {
+                reply_type reply_value = detail::decode<element>(msg, handler);
+                if (msg.failed) return;  // nothing was called, the connection ends instead
+                packet     new_msg(msg_header{{header.id.interface, header.id.id, header.id.cookie}, 128, 0});
+                encode_item(new_msg, type<reply_type>{}, reply_value);
+                if (!batched_replies) return s.communicator.send(new_msg, lane_of<element>);
+                if (detail::append_entry(*batched_replies, new_msg)) return;
+                // flush the replies collected so far, a reply too large for any batch frame goes on its own
+                if (batched_replies->size() > sizeof(msg_header)) s.communicator.send(*batched_replies);
+                *batched_replies = packet(detail::batch_header());
+                if (!detail::append_entry(*batched_replies, new_msg)) s.communicator.send(new_msg, lane_of<element>);
+            }
+        });
+}
+
+// Dispatches all calls of a batch frame through dispatch_call and answers them with a single batch frame.
+template <typename F>
+void dispatch_batch(server_session& s, message_parser& msg, F&& dispatch_call)
+{
+    packet replies(detail::batch_header());
+    detail::for_each_batched(msg,
+                             [&](msg_header const& call, message_parser& call_msg)
+                             {
+                                 dispatch_call(call, call_msg, &replies);
+                                 if (replies.size() > detail::batch_flush_size)
+                                 {
+                                     s.communicator.send(replies);
+                                     replies = packet(detail::batch_header());
+                                 }
+                             });
+    if (replies.size() > sizeof(msg_header)) s.communicator.send(replies);
+}
+
+// Answers the hello of a client. When its fingerprint matches one of the protocols served, the session
+// switches to the compact header of that protocol. Otherwise the session stops reading and shuts down
+// its sending side after the answer, returns false then. Closing right away would let the client see
+// the hang-up before the answer, it closes the connection once it read the answer instead.
+template <c::protocol... Ps>
+bool answer_hello(server_session& s, message_parser& msg)
+{
+    auto const     theirs         = decode_item(msg, type<uint64_t>{});
+    uint64_t const fingerprints[] = {fingerprint<Ps>...};
+    uint64_t       ours           = fingerprints[0];
+    compact_format format;
+    bool const     match = ((theirs == fingerprint<Ps> && (ours = theirs, format = compact_format::of<Ps>(), true)) || ...);
+
+    packet answer(msg_header{{control_interface, control::hello, 0}, sizeof(ours), 0});
+    encode_item(answer, type<uint64_t>{}, ours);
+    if (!match)
+    {
+        s.communicator.send(answer);
+        if (s.communicator.has_queued())
+            s.close();
+        else
+            ::shutdown(s.communicator.socket.native_handle(), SHUT_WR);
+        return false;
+    }
+    s.communicator.compact         = std::move(format);
+    s.communicator.compact_receive = true;
+    s.communicator.send_hello(answer);
+    return true;
+}
+
+// Applies a control::stream_credit of the client to the stream of the call it names.
+inline void grant_stream_credit(server_session& s, message_parser& msg)
+{
+    auto const [call, count] = decode_stream_credit(msg);
+    for (auto const& stream : s.streams)
+    {
+        auto state = stream.lock();
+        if (!state || state->id != call) continue;
+        if (count == 0)
+            state->done = true;
+        else
+            state->credit += count;
+        if (auto ready = std::exchange(state->on_ready, nullptr)) ready();
+        return;
+    }
+}
+
+// Dispatches a call to the handlers of the protocol named in its header, calls of other protocols are dropped.
+template <c::protocol_handlers... Hs>
+void route_method(server_session& s, msg_header const& header, message_parser& msg, packet* batched_replies, Hs&... handlers)
+{
+    (void)((header.protocol == Hs::protocol::hash &&
+            (dispatch_method<typename Hs::protocol>(s, header, msg, handlers.dispatcher, batched_replies), true)) ||
+           ...);
+}
+}  // namespace detail
+
 template <c::protocol P, c::method_group... Ts>
 requires(detail::are_in_protocol<P, typename std::decay_t<Ts>::id, typename std::decay_t<Ts>::methods>&&... &&
          true) void async_dispatch_messages(server_session& s, Ts&&... ts)
 {
     auto default_handler = [&s, ts...]() mutable { async_dispatch_messages<P>(s, ts...); };
     s.communicator.socket.async_wait(
-        boost::asio::socket_base::wait_read,
+        detail::wait_read,
         [&s, default_handler,
          interface_dispatcher =
              tiny_tuple::map<tiny_tuple::detail::item<typename std::decay_t<Ts>::id, decltype(std::decay_t<Ts>::dispatcher)>...>(
                  tiny_tuple::detail::item<typename std::decay_t<Ts>::id, decltype(std::decay_t<Ts>::dispatcher)>(
                      std::move(ts.dispatcher))...)](boost::system::error_code ec) mutable
         {
-            if (ec) {}
-            else
+            if (ec) return;
+            if (s.communicator.frame_available())
             {
                 // Consider splitting message receival and consumption into two parts:
-                // Firstly allow asynchronous message handling - i.e. by posting the the resulting invocation and
+                // allow asynchronous message handling - i.e. by posting the the resulting invocation and
                 // ensuring that the socket is used strictly synchronously or at least always form a single io_context
-                // wake. secondly to allow handling multiple protocols within a server on a single socket. That way
-                // versioning of the protocol could be achieved by always prefixing the messages with a protocol id,
-                // and or splitting up functionalities into multiple modules might be nicer.
+                // wake. Multiple protocols on a single socket are served by async_dispatch_protocols.
                 auto msg = s.communicator.peek_and_receive();
 
                 msg_header header = decode_item(msg, type<msg_header>{});
-                detail::forward_item<P>(  //
-                    header.id.interface, header.id.id, interface_dispatcher,
-                    [&s, &header, &msg](auto& handler, auto const& signature)
-                    {
-                        using reply_type = detail::just_return_type_t<std::decay_t<decltype(signature)>>;
-                        if constexpr (std::is_same_v<void, reply_type>) { detail::decode<std::decay_t<decltype(signature)>>(msg, handler); }
-                        else
-                        {
-                            reply_type reply_value = detail::decode<std::decay_t<decltype(signature)>>(msg, handler);
-                            packet     new_msg(msg_header{{header.id.interface, header.id.id, header.id.cookie}, 128, 0});
-                            encode_item(new_msg, type<reply_type>{}, reply_value);
-                            s.communicator.send(new_msg);
-                        }
-                    });
-                default_handler();
+                if (header.id.interface == detail::control_interface && header.id.id == detail::control::batch)
+                    detail::dispatch_batch(s, msg,
+                                           [&](msg_header const& call, detail::message_parser& call_msg, packet* replies)
+                                           { detail::dispatch_method<P>(s, call, call_msg, interface_dispatcher, replies); });
+                else if (header.id.interface == detail::control_interface && header.id.id == detail::control::hello)
+                {
+                    if (!detail::answer_hello<P>(s, msg)) return;
+                }
+                else if (header.id.interface == detail::control_interface && header.id.id == detail::control::stream_credit)
+                    detail::grant_stream_credit(s, msg);
+                else
+                    detail::dispatch_method<P>(s, header, msg, interface_dispatcher, nullptr);
+                s.communicator.release_frame();
+                if (msg.failed) s.communicator.stop_receiving(detail::protocol_error());
             }
+            default_handler();
+        });
+}
+
+/**
+ * Serves several protocols on one session. Each message is routed to the handlers of the protocol
+ * named in its header, by comparing it against the protocol hashes known at compile time.
+ */
+template <c::protocol_handlers... Hs>
+requires(sizeof...(Hs) > 0 && detail::are_distinct<Hs::protocol::hash...>) void async_dispatch_protocols(server_session& s, Hs... handlers)
+{
+    s.communicator.socket.async_wait(
+        detail::wait_read,
+        [&s, handlers...](boost::system::error_code ec) mutable
+        {
+            if (ec) return;
+            if (s.communicator.frame_available())
+            {
+                auto       msg    = s.communicator.peek_and_receive();
+                msg_header header = decode_item(msg, type<msg_header>{});
+                if (header.id.interface == detail::control_interface && header.id.id == detail::control::batch)
+                    detail::dispatch_batch(s, msg,
+                                           [&](msg_header const& call, detail::message_parser& call_msg, packet* replies)
+                                           { detail::route_method(s, call, call_msg, replies, handlers...); });
+                else if (header.id.interface == detail::control_interface && header.id.id == detail::control::hello)
+                {
+                    if (!detail::answer_hello<typename Hs::protocol...>(s, msg)) return;
+                }
+                else if (header.id.interface == detail::control_interface && header.id.id == detail::control::stream_credit)
+                    detail::grant_stream_credit(s, msg);
+                else
+                    detail::route_method(s, header, msg, nullptr, handlers...);
+                s.communicator.release_frame();
+                if (msg.failed) s.communicator.stop_receiving(detail::protocol_error());
+            }
+            async_dispatch_protocols(s, std::move(handlers)...);
         });
 }
 
@@ -109,9 +475,30 @@ void send_signal(I, S, server_session& session, Cs&&... params)
 {
     using iface     = get_interface<P, I>;
     using signature = detail::get_signature<iface, S>;
-    packet new_msg(msg_header{{I::hash, id_of_item<iface, S>, 0}, 128, 0});
-    detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
-    session.communicator.send(new_msg);
+    static_assert(!(detail::is_conflated<signature> && detail::is_delta_encoded<signature>),
+                  "a delta encoded signal cannot be conflated, the receiver needs every difference");
+    packet new_msg(msg_header{{I::hash, id_of_item<iface, S>, 0}, 128, 0, P::hash});
+    if constexpr (detail::is_conflated<signature>)
+    {
+        auto key = detail::conflation_key<signature>(I::hash, id_of_item<iface, S>, params...);
+        detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
+        session.communicator.send(new_msg, key, detail::lane_of<signature>);
+    }
+    else if constexpr (detail::is_delta_encoded<signature>)
+    {
+        packet full_msg(msg_header{{I::hash, id_of_item<iface, S>, 0}, 128, 0});
+        detail::encode<signature>(full_msg, std::forward<Cs>(params)...);
+        auto& state = detail::delta_state_of(session.delta_states, (static_cast<uint64_t>(I::hash) << 16) | id_of_item<iface, S>);
+        detail::encode_delta(state, detail::full_snapshot_interval<signature>, full_msg, new_msg);
+        new_msg.fds   = std::move(full_msg.fds);
+        new_msg.creds = full_msg.creds;
+        session.communicator.send(new_msg, detail::lane_of<signature>);
+    }
+    else
+    {
+        detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
+        session.communicator.send(new_msg, detail::lane_of<signature>);
+    }
 }
 
 template <c::protocol P, c::interface_id I, c::signal_name S, typename... Cs>
@@ -120,10 +507,122 @@ auto dispatch_signal(I, S, Cs&&... params)
 {
     using iface     = get_interface<P, I>;
     using signature = detail::get_signature<iface, S>;
-    packet new_msg(msg_header{{I::hash, id_of_item<iface, S>, 0}, 128, 0});
-    detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
+    static_assert(!detail::is_delta_encoded<signature>, "delta encoded signals depend on the session, use send_signal");
+    packet new_msg(msg_header{{I::hash, id_of_item<iface, S>, 0}, 128, 0, P::hash});
+    if constexpr (detail::is_conflated<signature>)
+    {
+        auto key = detail::conflation_key<signature>(I::hash, id_of_item<iface, S>, params...);
+        detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
+        new_msg.commit_to_header();
+        return [msg_to_dispatch = std::move(new_msg), key](server_session& session)
+        { session.communicator.send(&msg_to_dispatch.header, key, detail::lane_of<signature>); };
+    }
+    else
+    {
+        detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
+        new_msg.commit_to_header();
+        return [msg_to_dispatch = std::move(new_msg)](server_session& session)
+        { session.communicator.send(&msg_to_dispatch.header, detail::lane_of<signature>); };
+    }
+}
+
+/**
+ * A signal encoded once, for signals sent over and over with few changing fields like heartbeats or
+ * status updates. Each parameter of fixed size has a patch slot: set<Index> overwrites its bytes in
+ * place and sending hands the prepared frame to the session without encoding anything. Sessions copy
+ * frames they have to queue, so patching right after a send does not alter the frame sent.
+ */
+template <typename Signature>
+class signal_template
+{
+public:
+    using parameters = typename detail::impl::as_tuple<typename detail::impl::to_list<Signature>::type>::type;
+
+    template <typename... Cs>
+    explicit signal_template(msg_header const& header, Cs&&... params)
+        : message(header),
+          interface(header.id.interface),
+          id(header.id.id),
+          key(detail::conflation_key<Signature>(header.id.interface, header.id.id, params...))
+    {
+        encode_parameters(std::index_sequence_for<Cs...>{}, std::forward_as_tuple(std::forward<Cs>(params)...));
+        message.coalesce();
+        message.commit_to_header();
+    }
+
+    template <std::size_t Index, typename T>
+    void set(T const& value) noexcept
+    {
+        using param_type = std::tuple_element_t<Index, parameters>;
+        static_assert(is_trivially_serializable_v<param_type>, "only parameters of fixed size have a patch slot");
+        param_type const converted = value;
+        std::memcpy(message.buffers[0].data() + offsets[Index], &converted, sizeof(converted));
+        if constexpr (Index == detail::conflation_key_index<Signature>) key = detail::conflation_key_of<Signature>(interface, id, converted);
+    }
+
+    void operator()(server_session& session) const
+    {
+        if constexpr (detail::is_conflated<Signature>)
+            session.communicator.send(&message.header, key, detail::lane_of<Signature>);
+        else
+            session.communicator.send(&message.header, detail::lane_of<Signature>);
+    }
+
+private:
+    packet                                                 message;
+    std::array<std::size_t, std::tuple_size_v<parameters>> offsets{};  // of each parameter in the first buffer
+    uint32_t                                               interface;
+    uint16_t                                               id;
+    uint64_t                                               key;
+
+    template <std::size_t... Is, typename Params>
+    void encode_parameters(std::index_sequence<Is...>, Params&& params)
+    {
+        ((offsets[Is] = message.size(),
+          detail::impl::internal_encode_item(message, type<std::tuple_element_t<Is, parameters>>{}, std::get<Is>(std::move(params)))),
+         ...);
+    }
+};
+
+template <c::protocol P, c::interface_id I, c::signal_name S, typename... Cs>
+requires detail::is_in_protocol<P, I, S>
+auto make_signal_template(I, S, Cs&&... params)
+{
+    using iface     = get_interface<P, I>;
+    using signature = detail::get_signature<iface, S>;
+    static_assert(!detail::is_delta_encoded<signature>, "delta encoded signals depend on the session, use send_signal");
+    return signal_template<signature>(msg_header{{I::hash, id_of_item<iface, S>, 0}, 128, 0, P::hash}, std::forward<Cs>(params)...);
+}
+
+/**
+ * Encodes a control::invalidate for the replies of the cacheable method M that clients keep, of all its
+ * calls, or with params of the calls with exactly these arguments. Returns a callable sending it to a
+ * session. The message goes out on the bulk lane, behind every reply the session queued before, so
+ * that a stale reply cannot reach the client after the invalidation and be cached again.
+ */
+template <c::protocol P, c::interface_id I, c::method_name M, typename... Cs>
+requires detail::is_in_protocol<P, I, M>
+auto dispatch_invalidation(I, M, Cs&&... params)
+{
+    using iface     = get_interface<P, I>;
+    using signature = detail::get_signature<iface, M>;
+    using arguments = typename detail::impl::as_tuple<typename detail::impl::to_list<signature>::type>::type;
+    static_assert(detail::is_cacheable<signature>, "only the replies of cacheable methods are kept by the client");
+    static_assert(sizeof...(Cs) == 0 || sizeof...(Cs) == std::tuple_size_v<arguments>, "either all arguments or none select the calls");
+    packet new_msg(msg_header{{detail::control_interface, detail::control::invalidate, 0}, 128, 0});
+    encode_item(new_msg, type<uint32_t>{}, I::hash);
+    encode_item(new_msg, type<uint16_t>{}, id_of_item<iface, M>);
+    if constexpr (sizeof...(Cs) != 0) detail::encode<signature>(new_msg, std::forward<Cs>(params)...);
     new_msg.commit_to_header();
-    return [msg_to_dispatch = std::move(new_msg)](server_session& session) { session.communicator.send(&msg_to_dispatch.header); };
+    return [msg_to_dispatch = std::move(new_msg)](server_session& session) { session.communicator.send(&msg_to_dispatch.header, lane::bulk); };
+}
+
+// Drops the cached replies of M on the client of the session, see dispatch_invalidation.
+template <c::protocol P, c::interface_id I, c::method_name M, typename... Cs>
+requires detail::is_in_protocol<P, I, M>
+void invalidate_cached(I i, M m, server_session& session, Cs&&... params)
+{
+    dispatch_invalidation<P>(i, m, std::forward<Cs>(params)...)(session);
 }
 
 }  // namespace tiny_ipc
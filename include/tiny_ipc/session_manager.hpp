@@ -0,0 +1,280 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_SESSION_MANAGER_H_INCLUDED
+#define TINY_IPC_SESSION_MANAGER_H_INCLUDED
+#ifdef TINY_IPC_USE_EPOLL
+#error "session_manager requires Boost.Asio, with TINY_IPC_USE_EPOLL accept connections with epoll::acceptor"
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <vector>
+#include <tiny_ipc/server_session.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+namespace tiny_ipc
+{
+/**
+ * Refers to a session of a session_manager. The generation tells apart sessions that were stored
+ * in the same slot, so a handle of a closed session never refers to a later one.
+ */
+struct session_handle
+{
+    uint32_t index{std::numeric_limits<uint32_t>::max()};
+    uint32_t generation{0};
+
+    friend bool operator==(session_handle const&, session_handle const&) = default;
+};
+
+struct session_limits
+{
+    std::size_t    max_sessions{std::numeric_limits<std::size_t>::max()};
+    double         accept_rate{0};    // connections accepted per second, 0 does not limit the rate
+    std::size_t    accept_burst{16};  // connections accepted at once before accept_rate applies
+    receive_policy receive;           // of each session, the sessions share its buffer_pool
+};
+
+/**
+ * Accepts connections on a unix socket and owns a server_session for each of them.
+ *
+ * Sessions are kept in slots that are reused after a session closed, so opening and closing a
+ * session is O(1) and does not allocate once the slots exist. The open sessions are additionally
+ * listed in a dense array for broadcasts. Pending connections are accepted in one go whenever the
+ * listening socket becomes readable. While max_sessions are open or the accept_rate is exhausted,
+ * further connections wait in the listen backlog.
+ *
+ * on_open is invoked for each new session and typically starts async_dispatch_messages on it,
+ * on_close is invoked with the error that ended the session while the session is still valid.
+ */
+struct session_manager
+{
+    using socket_type   = boost::asio::local::stream_protocol::socket;
+    using open_handler  = std::function<void(session_handle, server_session&)>;
+    using close_handler = std::function<void(session_handle, boost::system::error_code)>;
+
+    session_manager(boost::asio::io_context& ctx, boost::asio::local::stream_protocol::endpoint const& endpoint,
+                    open_handler on_open, close_handler on_close = {}, session_limits limits = {})
+        : io_ctx(ctx),
+          acceptor(ctx, endpoint),
+          throttle(ctx),
+          on_open(std::move(on_open)),
+          on_close(std::move(on_close)),
+          limits(limits),
+          tokens(static_cast<double>(limits.accept_burst)),
+          last_refill(std::chrono::steady_clock::now())
+    {
+        acceptor.non_blocking(true);
+    }
+    session_manager(session_manager const&)            = delete;
+    session_manager& operator=(session_manager const&) = delete;
+
+    void start() { wait_for_connections(); }
+
+    // Stops accepting and closes all sessions, on_close is invoked for each of them.
+    void stop()
+    {
+        boost::system::error_code ec;
+        acceptor.close(ec);
+        throttle.cancel();
+        for (auto const& item : live) item.session->close();
+    }
+
+    std::size_t size() const noexcept { return live.size(); }
+
+    // Returns nullptr when the session is closed.
+    server_session* find(session_handle handle) noexcept
+    {
+        if (handle.index >= slots.size()) return nullptr;
+        auto& s = slots[handle.index];
+        return s.generation == handle.generation && s.value ? &s.value->session : nullptr;
+    }
+
+    // Closes the session, it is released after on_close was invoked.
+    void close(session_handle handle)
+    {
+        if (auto* session = find(handle)) session->close();
+    }
+
+    // Invokes f with the handle and the server_session of each open session.
+    template <typename F>
+    void for_each(F&& f)
+    {
+        for (std::size_t i = 0; i != live.size(); ++i) f(session_handle{live[i].index, slots[live[i].index].generation}, *live[i].session);
+    }
+
+private:
+    static constexpr uint32_t no_slot = std::numeric_limits<uint32_t>::max();
+
+    struct entry
+    {
+        socket_type    socket;
+        server_session session;
+        entry(socket_type&& s, session_manager& manager, session_handle handle)
+            : socket(std::move(s)),
+              session(socket, [&manager, handle](boost::system::error_code ec, server_session&) { manager.session_failed(handle, ec); })
+        {
+        }
+    };
+    struct slot
+    {
+        std::optional<entry> value;
+        uint32_t             generation{0};
+        uint32_t             next_free{no_slot};
+        uint32_t             live_index{0};
+    };
+    struct live_session
+    {
+        server_session* session;
+        uint32_t        index;
+    };
+
+    boost::asio::io_context&                      io_ctx;
+    boost::asio::local::stream_protocol::acceptor acceptor;
+    boost::asio::steady_timer                     throttle;
+    open_handler                                  on_open;
+    close_handler                                 on_close;
+    session_limits                                limits;
+    std::deque<slot>                              slots;  // a deque keeps the sessions in place when it grows
+    std::vector<live_session>                     live;
+    uint32_t                                      free_slots{no_slot};
+    double                                        tokens;
+    std::chrono::steady_clock::time_point         last_refill;
+    bool                                          waiting{false};
+
+    void wait_for_connections()
+    {
+        if (waiting || !acceptor.is_open()) return;
+        waiting = true;
+        acceptor.async_wait(boost::asio::socket_base::wait_read,
+                            [this](boost::system::error_code ec)
+                            {
+                                waiting = false;
+                                if (!ec) accept_pending();
+                            });
+    }
+
+    // token bucket of the accept rate
+    bool take_token()
+    {
+        if (limits.accept_rate <= 0) return true;
+        auto const now = std::chrono::steady_clock::now();
+        tokens         = std::min(static_cast<double>(limits.accept_burst),
+                                  tokens + std::chrono::duration<double>(now - last_refill).count() * limits.accept_rate);
+        last_refill    = now;
+        if (tokens < 1) return false;
+        tokens -= 1;
+        return true;
+    }
+
+    void accept_pending()
+    {
+        while (live.size() < limits.max_sessions)
+        {
+            if (!take_token())
+            {
+                throttle.expires_after(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>((1 - tokens) / limits.accept_rate)));
+                throttle.async_wait(
+                    [this](boost::system::error_code ec)
+                    {
+                        if (!ec) accept_pending();
+                    });
+                return;
+            }
+            socket_type               socket(io_ctx);
+            boost::system::error_code ec;
+            acceptor.accept(socket, ec);
+            if (ec)
+            {
+                if (limits.accept_rate > 0) tokens += 1;
+                if (ec == boost::asio::error::would_block || ec == boost::asio::error::try_again) break;
+                // out of descriptors or similar, retry later instead of spinning on the readable socket
+                throttle.expires_after(std::chrono::milliseconds(100));
+                throttle.async_wait(
+                    [this](boost::system::error_code ec)
+                    {
+                        if (!ec) accept_pending();
+                    });
+                return;
+            }
+            open(std::move(socket));
+        }
+        // at max_sessions accepting resumes once a session is released
+        if (live.size() < limits.max_sessions) wait_for_connections();
+    }
+
+    void open(socket_type&& socket)
+    {
+        uint32_t index = free_slots;
+        if (index == no_slot)
+        {
+            index = slots.size();
+            slots.emplace_back();
+        }
+        else
+            free_slots = slots[index].next_free;
+
+        auto&                s = slots[index];
+        session_handle const handle{index, s.generation};
+        s.value.emplace(std::move(socket), *this, handle);
+        s.value->session.communicator.receive = limits.receive;
+        s.live_index = live.size();
+        live.push_back({&s.value->session, index});
+        on_open(handle, s.value->session);
+    }
+
+    void session_failed(session_handle handle, boost::system::error_code ec)
+    {
+        if (on_close) on_close(handle, ec);
+        // the session is still executing its error handler
+        boost::asio::post(io_ctx, [this, handle] { release(handle); });
+    }
+
+    void release(session_handle handle)
+    {
+        if (!find(handle)) return;
+        auto& s = slots[handle.index];
+
+        auto const moved              = live.back();
+        live[s.live_index]            = moved;
+        slots[moved.index].live_index = s.live_index;
+        live.pop_back();
+
+        s.value.reset();
+        ++s.generation;
+        s.next_free = free_slots;
+        free_slots  = handle.index;
+        if (live.size() + 1 == limits.max_sessions) accept_pending();
+    }
+};
+
+// Sends a signal to every open session of the manager, the signal is encoded once.
+template <c::protocol P, c::interface_id I, c::signal_name S, typename... Cs>
+requires detail::is_in_protocol<P, I, S>
+void broadcast_signal(I i, S s, session_manager& sessions, Cs&&... params)
+{
+    auto send = dispatch_signal<P>(i, s, std::forward<Cs>(params)...);
+    sessions.for_each([&send](session_handle, server_session& session) { send(session); });
+}
+
+// Drops the cached replies of a cacheable method on every client of the manager, see dispatch_invalidation.
+template <c::protocol P, c::interface_id I, c::method_name M, typename... Cs>
+requires detail::is_in_protocol<P, I, M>
+void broadcast_invalidation(I i, M m, session_manager& sessions, Cs&&... params)
+{
+    auto send = dispatch_invalidation<P>(i, m, std::forward<Cs>(params)...);
+    sessions.for_each([&send](session_handle, server_session& session) { send(session); });
+}
+
+}  // namespace tiny_ipc
+
+#endif
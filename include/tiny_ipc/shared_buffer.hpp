@@ -0,0 +1,241 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_SHARED_BUFFER_H_INCLUDED
+#define TINY_IPC_SHARED_BUFFER_H_INCLUDED
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <tiny_ipc/fd.hpp>
+
+namespace tiny_ipc
+{
+namespace detail
+{
+// A memfd of fixed size mapped into this process, unmapped with its last owner.
+struct shared_region
+{
+    tiny_ipc::fd file;
+    void*        base{MAP_FAILED};
+    std::size_t  size{0};
+    bool         writable{false};
+
+    shared_region() = default;
+    shared_region(shared_region const&)            = delete;
+    shared_region& operator=(shared_region const&) = delete;
+    ~shared_region() { unmap(); }
+
+    bool map(int protection, int flags = MAP_SHARED)
+    {
+        base = ::mmap(nullptr, size, protection, flags, file, 0);
+        return base != MAP_FAILED;
+    }
+    void unmap()
+    {
+        if (base != MAP_FAILED) ::munmap(base, size);
+        base = MAP_FAILED;
+    }
+};
+
+// Mappings of received buffers by inode. A buffer sent again, or a recycled one of the sender, maps
+// to the same inode, so it is found while a handle to it is alive or it is among the most recently
+// received ones.
+class mapping_cache
+{
+public:
+    static constexpr std::size_t keep_recent = 16;
+
+    static mapping_cache& instance()
+    {
+        static mapping_cache cache;
+        return cache;
+    }
+
+    // Empty when the file is no memfd sealed against shrinking or cannot be mapped.
+    std::shared_ptr<shared_region> map(tiny_ipc::fd file)
+    {
+        struct stat info;
+        auto const  seals = ::fcntl(file, F_GET_SEALS);
+        if (seals == -1 || !(seals & F_SEAL_SHRINK) || ::fstat(file, &info) != 0 || info.st_size == 0) return {};
+        auto const key = std::make_pair(info.st_dev, info.st_ino);
+
+        std::lock_guard lock(mutex);
+        if (auto known = live.find(key); known != live.end())
+        {
+            auto region = known->second.lock();
+            if (region && region->size == static_cast<std::size_t>(info.st_size)) return keep(std::move(region));
+        }
+        auto region  = std::make_shared<shared_region>();
+        region->file = std::move(file);
+        region->size = static_cast<std::size_t>(info.st_size);
+        // a shared mapping of a descriptor opened for writing would keep the sender from sealing the contents,
+        // pages of a private read only mapping are those of the file as long as nothing writes to them
+        if (!region->map(PROT_READ, MAP_PRIVATE)) return {};
+        std::erase_if(live, [](auto const& entry) { return entry.second.expired(); });
+        live.insert_or_assign(key, region);
+        return keep(std::move(region));
+    }
+
+private:
+    std::mutex                                                      mutex;
+    std::map<std::pair<dev_t, ino_t>, std::weak_ptr<shared_region>> live;
+    std::deque<std::shared_ptr<shared_region>>                      recent;
+
+    std::shared_ptr<shared_region> keep(std::shared_ptr<shared_region> region)
+    {
+        if (std::find(recent.begin(), recent.end(), region) == recent.end())
+        {
+            if (recent.size() == keep_recent) recent.pop_front();
+            recent.push_back(region);
+        }
+        return region;
+    }
+};
+}  // namespace detail
+
+/**
+ * An array of T in a memfd, the file descriptor is sent instead of the contents. The size of the file
+ * is sealed, so a receiver can map it without risking SIGBUS. Buffers from a shared_buffer_pool are
+ * writable until seal() also seals the contents, unsealed buffers go back to the pool when the last
+ * local handle is dropped. Received buffers are read only and their mappings are reused when the same
+ * memfd arrives again.
+ */
+template <typename T>
+class shared_buffer
+{
+    static_assert(std::is_trivially_copyable_v<T>, "shared buffers hold trivially copyable elements");
+
+public:
+    shared_buffer() = default;
+    shared_buffer(std::shared_ptr<detail::shared_region> region, std::size_t count) : region(std::move(region)), count(count) {}
+
+    // Empty when the buffer is empty or was received with a size that does not fit the file.
+    std::span<T const> data() const
+    {
+        if (!region) return {};
+        return {static_cast<T const*>(region->base), count};
+    }
+    // Empty unless the buffer is writable.
+    std::span<T> mutable_data() const
+    {
+        if (!region || !region->writable) return {};
+        return {static_cast<T*>(region->base), count};
+    }
+    std::size_t         size() const noexcept { return region ? count : 0; }
+    tiny_ipc::fd const& file() const
+    {
+        static tiny_ipc::fd const none;
+        return region ? region->file : none;
+    }
+    // Whether the contents can no longer change.
+    bool sealed() const { return region && (::fcntl(region->file, F_GET_SEALS) & F_SEAL_WRITE); }
+
+    // Seals the contents, the buffer stays read only and is not recycled. The writable mapping has to
+    // go first, so only the sole owner of the buffer can seal it and spans obtained before are invalidated.
+    // Returns false when other copies exist or the file cannot be sealed, the buffer stays writable then.
+    bool seal()
+    {
+        if (!region || !region->writable) return sealed();
+        if (region.use_count() > 1) return false;
+        region->unmap();
+        bool const done  = ::fcntl(region->file, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_SEAL) == 0;
+        region->writable = !done;
+        if (!region->map(done ? PROT_READ : PROT_READ | PROT_WRITE))
+        {
+            region->writable = false;  // keeps the pool from recycling a region without mapping
+            region.reset();
+        }
+        return done && region;
+    }
+
+private:
+    std::shared_ptr<detail::shared_region> region;
+    std::size_t                            count{0};
+};
+
+/**
+ * Creates shared buffers and recycles them. Buffer sizes are rounded up to a power of two of at least
+ * one page, an unsealed buffer dropped by all local owners serves the next allocation of its size.
+ * Since the receiver may still read a buffer the sender dropped, the protocol has to tell when a
+ * buffer is released, for example by the reply of the method it was passed to.
+ */
+class shared_buffer_pool
+{
+public:
+    explicit shared_buffer_pool(std::size_t max_idle = 8) : store(std::make_shared<idle_store>(max_idle)) {}
+
+    // Empty when no memfd could be created or mapped.
+    template <typename T>
+    shared_buffer<T> allocate(std::size_t count)
+    {
+        auto const page     = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        auto const capacity = std::bit_ceil(std::max(count * sizeof(T), page));
+        auto       region   = store->take(capacity);
+        if (!region)
+        {
+            region       = std::make_unique<detail::shared_region>();
+            region->file = tiny_ipc::fd(::memfd_create("tiny_ipc::shared_buffer", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+            region->size = capacity;
+            if (static_cast<int>(region->file) < 0 || ::ftruncate(region->file, static_cast<off_t>(capacity)) != 0 ||
+                ::fcntl(region->file, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0 || !region->map(PROT_READ | PROT_WRITE))
+                return {};
+            region->writable = true;
+        }
+        std::weak_ptr<idle_store> owner   = store;
+        auto                      recycle = [owner](detail::shared_region* released)
+        {
+            std::unique_ptr<detail::shared_region> region(released);
+            if (auto store = owner.lock(); store && region->writable) store->give_back(std::move(region));
+        };
+        return shared_buffer<T>(std::shared_ptr<detail::shared_region>(region.release(), recycle), count);
+    }
+
+    std::size_t idle_count() const
+    {
+        std::lock_guard lock(store->mutex);
+        return store->idle.size();
+    }
+
+private:
+    struct idle_store
+    {
+        explicit idle_store(std::size_t max_idle) : max_idle(max_idle) {}
+
+        std::unique_ptr<detail::shared_region> take(std::size_t capacity)
+        {
+            std::lock_guard lock(mutex);
+            auto it = std::find_if(idle.begin(), idle.end(), [capacity](auto const& region) { return region->size == capacity; });
+            if (it == idle.end()) return {};
+            auto region = std::move(*it);
+            idle.erase(it);
+            return region;
+        }
+        void give_back(std::unique_ptr<detail::shared_region> region)
+        {
+            std::lock_guard lock(mutex);
+            if (idle.size() < max_idle) idle.push_back(std::move(region));
+        }
+
+        std::mutex                                          mutex;
+        std::vector<std::unique_ptr<detail::shared_region>> idle;
+        std::size_t                                         max_idle;
+    };
+    std::shared_ptr<idle_store> store;
+};
+}  // namespace tiny_ipc
+
+#endif
@@ -0,0 +1,177 @@
+// Copyright (c) 2021 Andreas Pokorny
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TINY_IPC_SUBMISSION_QUEUE_H_INCLUDED
+#define TINY_IPC_SUBMISSION_QUEUE_H_INCLUDED
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <tiny_ipc/client.hpp>
+#include <tiny_ipc/detail/mpsc_queue.hpp>
+
+namespace tiny_ipc
+{
+/**
+ * Wraps a result handler or a completion, so that it is invoked on executor instead of the thread of
+ * the client. The reply is still decoded on the thread of the client.
+ */
+template <typename Executor, typename F>
+struct deliver_on
+{
+    Executor executor;
+    F        handler;
+};
+template <typename Executor, typename F>
+deliver_on(Executor, F) -> deliver_on<Executor, F>;
+
+namespace detail
+{
+template <typename F>
+struct is_deliver_on : std::false_type
+{
+};
+template <typename Executor, typename F>
+struct is_deliver_on<deliver_on<Executor, F>> : std::true_type
+{
+};
+
+template <typename R, typename Executor, typename F>
+auto make_posting_payload_handler(deliver_on<Executor, F> target)
+{
+    return [executor = std::move(target.executor), handler = std::move(target.handler)](message_parser*            parser,
+                                                                                        boost::system::error_code ec) mutable
+    {
+        if (parser)
+        {
+            auto reply = decode_item(*parser, type<R>());
+            if (!parser->failed)
+            {
+                post(executor, [handler = std::move(handler), reply = std::move(reply)]() mutable
+                     { invoke_reply_handler(handler, std::move(reply)); });
+                return;
+            }
+            ec = protocol_error();
+        }
+        post(executor, [handler = std::move(handler), ec]() mutable { invoke_error_handler(handler, ec); });
+    };
+}
+
+// An encoded call on its way to the thread of the client, the cookie is assigned there.
+struct submission
+{
+    client::active_request              request;  // payload_handler is empty for methods without reply
+    packet                              message;
+    lane                                priority;
+    std::chrono::steady_clock::duration timeout{0};
+};
+}  // namespace detail
+
+/**
+ * Lets any thread issue method calls on a client that runs on a single thread. The calling thread encodes
+ * the call and pushes it onto a lock free queue, the thread of the client is woken once for all calls
+ * pushed until it gets to drain the queue. It then assigns cookies, applies the flow_control of the
+ * client and writes the frames in push order. Result handlers are invoked on the thread of the client
+ * unless they are wrapped with deliver_on. Calls that reach the thread of the client after it was
+ * destroyed or disconnected complete with operation_aborted.
+ */
+class submission_queue
+{
+public:
+    explicit submission_queue(client& c) : shared(std::make_shared<state>(c)) {}
+
+    // May be called from any thread.
+    void submit(detail::submission call)
+    {
+        if (shared->pending.push(std::move(call))) detail::post(shared->executor, [shared = shared]() { shared->drain(); });
+    }
+
+private:
+    struct state
+    {
+        std::weak_ptr<client*>                 target;  // the queue may outlive the client through a pending drain
+        executor_type                          executor;
+        detail::mpsc_queue<detail::submission> pending;
+
+        explicit state(client& c) : target(c.self), executor(c.communicator.socket.get_executor()) {}
+
+        void drain()
+        {
+            // looked up per call, a result handler may destroy the client
+            pending.drain(
+                [this](detail::submission&& call)
+                {
+                    auto c = target.lock();
+                    issue(c ? *c : nullptr, std::move(call));
+                });
+        }
+
+        void issue(client* target, detail::submission&& call)
+        {
+            auto& request = call.request;
+            if (!target || !target->communicator.socket.is_open())
+            {
+                if (request.payload_handler) request.payload_handler(nullptr, detail::operation_aborted());
+                return;
+            }
+            request.id.cookie = target->gen_cookie();
+            std::memcpy(call.message.buffers[0].data() + offsetof(msg_id, cookie), &request.id.cookie, sizeof(request.id.cookie));
+            if (!request.payload_handler)
+            {
+                // takes no credit, but must not overtake the requests queued before it
+                if (!target->has_queued_before(call.priority)) return target->communicator.send(call.message, call.priority);
+                return target->enqueue(std::move(request), std::move(call.message), call.priority);
+            }
+
+            bool const out_of_credit = target->out_of_credit(request.id.interface, call.priority);
+            // the caller returned long ago, so fail_fast reports the rejection like back_pressure
+            if (out_of_credit && target->limits.on_overflow != overflow_policy::queue)
+                return request.payload_handler(nullptr, detail::no_buffer_space());
+            target->watch(request, call.timeout);
+            if (out_of_credit) return target->enqueue(std::move(request), std::move(call.message), call.priority);
+            target->active_requests.push_back(std::move(request));
+            target->communicator.send(call.message, call.priority);
+        }
+    };
+    std::shared_ptr<state> shared;  // kept alive by a pending drain
+};
+
+/**
+ * Encodes a method call on the calling thread and submits it to the thread of the client, may be called
+ * from any thread. ResultHandler is a callable taking the return value, a completion or either of those
+ * wrapped in deliver_on. Submitted calls bypass the reply cache and cannot be cancelled by cookie,
+ * streaming methods have to be called on the thread of the client.
+ */
+template <c::protocol P, c::interface_id I, c::method_name M, typename ResultHandler, typename... Cs>
+requires detail::is_in_protocol<P, I, M>
+request_status execute_method(I, M, submission_queue& queue, ResultHandler&& fun, Cs&&... params)
+{
+    using iface       = get_interface<P, I>;
+    using signature   = detail::get_signature<iface, M>;
+    using return_type = detail::just_return_type_t<signature>;
+    static_assert(!detail::is_streaming<signature>, "streaming methods cannot be submitted from other threads");
+    msg_id const       id{iface::hash, id_of_item<iface, M>, 0};
+    detail::submission call{{id}, packet(msg_header{id, 128, 0, P::hash}), detail::lane_of<signature>};
+    if constexpr (!std::is_same_v<void, return_type>)
+    {
+        if constexpr (detail::is_deliver_on<std::decay_t<ResultHandler>>::value)
+        {
+            call.timeout                 = detail::timeout_of(fun.handler);
+            call.request.payload_handler = detail::make_posting_payload_handler<return_type>(std::forward<ResultHandler>(fun));
+        }
+        else
+        {
+            call.timeout                 = detail::timeout_of(fun);
+            call.request.payload_handler = detail::make_payload_handler<return_type>(std::forward<ResultHandler>(fun));
+        }
+    }
+    detail::encode<signature>(call.message, std::forward<Cs>(params)...);
+    queue.submit(std::move(call));
+    return request_status::queued;
+}
+}  // namespace tiny_ipc
+
+#endif